@@ -16,7 +16,7 @@ namespace dae
 			//todo: W3
 			ColorRGB pho{ cd * kd };
 			
-			return { pho/float(M_PI)};
+			return { pho/PI};
 		}
 
 		static ColorRGB Lambert(const ColorRGB& kd, const ColorRGB& cd)
@@ -25,7 +25,7 @@ namespace dae
 			
 			ColorRGB pho{ cd * kd };
 
-			return { pho / float(M_PI) };
+			return { pho / PI };
 		}
 
 		/**
@@ -84,7 +84,7 @@ namespace dae
 
 			float denominatorSquared{ (nhDotSquared * (roughnessSquared - 1) + 1) * (nhDotSquared * (roughnessSquared - 1) + 1) };
 
-			float D = (roughnessSquared) / ((float(M_PI) * denominatorSquared));
+			float D = (roughnessSquared) / ((PI * denominatorSquared));
 
 			return D;
 		}
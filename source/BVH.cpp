@@ -0,0 +1,944 @@
+#include "BVH.h"
+
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <numeric>
+#include <utility>
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		//Primitives a thread bins or partitions at once at the top of the tree. Fixed, not derived from the
+		//thread count, so every thread count builds the same tree
+		constexpr uint32_t BlockSize{ 2048 };
+
+		uint32_t GetBlockCount(uint32_t primitiveCount)
+		{
+			return (primitiveCount + BlockSize - 1) / BlockSize;
+		}
+
+		//Calls function(index) for every index in [0, count), on all threads of the pool if there is one
+		template<typename Function>
+		void ForEach(ThreadPool* pThreadPool, uint32_t count, const Function& function)
+		{
+			if (!pThreadPool || count <= 1)
+			{
+				for (uint32_t i{}; i < count; ++i)
+				{
+					function(i);
+				}
+				return;
+			}
+
+			pThreadPool->ParallelFor(count, 1, [&function](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						function(i);
+					}
+				});
+		}
+
+		/**
+		 * \brief Builds every subtree into its own node array, one thread per subtree, then appends them to nodes
+		 * \param subtrees root node and its depth, every subtree only touches its own range of primitives
+		 * \param subdivide callable as subdivide(std::vector<BVHNode>& subtreeNodes, uint32_t depth), subdivides
+		 * subtreeNodes[0] (a copy of the root) by appending to subtreeNodes
+		 */
+		template<typename Function>
+		void AppendSubtrees(std::vector<BVHNode>& nodes, const std::vector<std::pair<uint32_t, uint32_t>>& subtrees, ThreadPool* pThreadPool, const Function& subdivide)
+		{
+			std::vector<std::vector<BVHNode>> subtreeNodes(subtrees.size());
+			ForEach(pThreadPool, static_cast<uint32_t>(subtrees.size()), [&](uint32_t subtree)
+				{
+					const auto [rootIndex, depth] { subtrees[subtree] };
+					std::vector<BVHNode>& currentNodes{ subtreeNodes[subtree] };
+
+					//A binary tree with N leaves never has more than 2N - 1 nodes, so node references stay valid
+					currentNodes.reserve(nodes[rootIndex].primitiveCount * size_t(2) - 1);
+					currentNodes.push_back(nodes[rootIndex]);
+					subdivide(currentNodes, depth);
+				});
+
+			//The root replaces the node it was copied from, the other nodes are appended in their order
+			for (size_t subtree{}; subtree < subtrees.size(); ++subtree)
+			{
+				const std::vector<BVHNode>& currentNodes{ subtreeNodes[subtree] };
+				const uint32_t offset{ static_cast<uint32_t>(nodes.size()) - 1 };
+
+				for (size_t i{}; i < currentNodes.size(); ++i)
+				{
+					BVHNode& node{ i == 0 ? nodes[subtrees[subtree].first] : nodes.emplace_back() };
+					node = currentNodes[i];
+					if (!node.IsLeaf())
+						node.leftFirst += offset;
+				}
+			}
+		}
+
+#pragma region Linear BVH
+		//Primitives the radix sort histograms and scatters at once per thread
+		constexpr uint32_t SortBlockSize{ 1 << 14 };
+		constexpr uint32_t RadixBits{ 8 };
+		constexpr uint32_t RadixSize{ 1 << RadixBits };
+
+		template<typename Key>
+		struct MortonPrimitive
+		{
+			Key code{};
+			uint32_t index{};
+		};
+
+		//Spreads the low 10 bits of value over every third bit
+		uint32_t SpreadBits(uint32_t value)
+		{
+			value = (value * 0x00010001u) & 0xFF0000FFu;
+			value = (value * 0x00000101u) & 0x0F00F00Fu;
+			value = (value * 0x00000011u) & 0xC30C30C3u;
+			value = (value * 0x00000005u) & 0x49249249u;
+			return value;
+		}
+
+		//Spreads the low 21 bits of value over every third bit
+		uint64_t SpreadBits(uint64_t value)
+		{
+			value &= 0x1FFFFF;
+			value = (value | value << 32) & 0x1F00000000FFFFull;
+			value = (value | value << 16) & 0x1F0000FF0000FFull;
+			value = (value | value << 8) & 0x100F00F00F00F00Full;
+			value = (value | value << 4) & 0x10C30C30C30C30C3ull;
+			value = (value | value << 2) & 0x1249249249249249ull;
+			return value;
+		}
+
+		//Morton code of the centroid in a grid of 2^(bits per axis) cells per axis over the centroid bounds
+		template<typename Key>
+		Key GetMortonCode(const Vector3& centroid, const Vector3& centroidMin, const Vector3& cellScale)
+		{
+			constexpr float maxCell{ sizeof(Key) == 4 ? 1023.f : 2097151.f };
+			const Key x{ static_cast<Key>(std::clamp((centroid.x - centroidMin.x) * cellScale.x, 0.f, maxCell)) };
+			const Key y{ static_cast<Key>(std::clamp((centroid.y - centroidMin.y) * cellScale.y, 0.f, maxCell)) };
+			const Key z{ static_cast<Key>(std::clamp((centroid.z - centroidMin.z) * cellScale.z, 0.f, maxCell)) };
+			return SpreadBits(x) << 2 | SpreadBits(y) << 1 | SpreadBits(z);
+		}
+
+		//Least significant digit first, every pass is stable: blocks count their digits, the counts are summed up
+		//digit by digit (block order within a digit), then every block scatters its primitives to their place
+		template<typename Key>
+		void RadixSort(std::vector<MortonPrimitive<Key>>& primitives, ThreadPool* pThreadPool)
+		{
+			constexpr uint32_t keyBits{ sizeof(Key) == 4 ? 30 : 63 };
+			const uint32_t count{ static_cast<uint32_t>(primitives.size()) };
+			const uint32_t blockCount{ (count + SortBlockSize - 1) / SortBlockSize };
+
+			std::vector<MortonPrimitive<Key>> sorted(count);
+			std::vector<uint32_t> offsets(size_t(blockCount) * RadixSize);
+
+			for (uint32_t shift{}; shift < keyBits; shift += RadixBits)
+			{
+				std::fill(offsets.begin(), offsets.end(), 0u);
+				ForEach(pThreadPool, blockCount, [&](uint32_t block)
+					{
+						uint32_t* pCounts{ offsets.data() + size_t(block) * RadixSize };
+						const uint32_t end{ std::min((block + 1) * SortBlockSize, count) };
+						for (uint32_t i{ block * SortBlockSize }; i < end; ++i)
+						{
+							++pCounts[(primitives[i].code >> shift) & (RadixSize - 1)];
+						}
+					});
+
+				//Nothing to do when every primitive has the same digit (e.g. the unused top bits of small meshes)
+				uint32_t offset{};
+				bool isSorted{ false };
+				for (uint32_t digit{}; digit < RadixSize && !isSorted; ++digit)
+				{
+					uint32_t digitCount{};
+					for (uint32_t block{}; block < blockCount; ++block)
+					{
+						uint32_t& blockOffset{ offsets[size_t(block) * RadixSize + digit] };
+						const uint32_t blockCountOfDigit{ blockOffset };
+						blockOffset = offset;
+						offset += blockCountOfDigit;
+						digitCount += blockCountOfDigit;
+					}
+					isSorted = digitCount == count;
+				}
+				if (isSorted)
+					continue;
+
+				ForEach(pThreadPool, blockCount, [&](uint32_t block)
+					{
+						uint32_t* pOffsets{ offsets.data() + size_t(block) * RadixSize };
+						const uint32_t end{ std::min((block + 1) * SortBlockSize, count) };
+						for (uint32_t i{ block * SortBlockSize }; i < end; ++i)
+						{
+							sorted[pOffsets[(primitives[i].code >> shift) & (RadixSize - 1)]++] = primitives[i];
+						}
+					});
+				primitives.swap(sorted);
+			}
+		}
+
+		//Primitives of the range that go to the left child: the ones before the highest bit in which the first
+		//and last code differ flips (the codes are sorted and share every bit above it), or half of them when
+		//all codes are equal
+		template<typename Key>
+		uint32_t FindLinearSplit(const MortonPrimitive<Key>* pPrimitives, uint32_t count)
+		{
+			const Key firstCode{ pPrimitives[0].code };
+			const Key lastCode{ pPrimitives[count - 1].code };
+			if (firstCode == lastCode)
+				return count / 2;
+
+			const Key splitBit{ std::bit_floor(static_cast<Key>(firstCode ^ lastCode)) };
+			const MortonPrimitive<Key>* pRight{ std::partition_point(pPrimitives, pPrimitives + count, [splitBit](const MortonPrimitive<Key>& primitive)
+				{
+					return (primitive.code & splitBit) == 0;
+				}) };
+			return static_cast<uint32_t>(pRight - pPrimitives);
+		}
+
+		//Splits the node until its leaves hold at most leafSize primitives, then sets the bounds bottom up
+		template<typename Key>
+		void SubdivideLinear(std::vector<BVHNode>& nodes, uint32_t nodeIndex, const std::vector<MortonPrimitive<Key>>& primitives, const std::vector<AABB>& primitiveBounds, uint32_t leafSize, uint32_t depth)
+		{
+			BVHNode& node{ nodes[nodeIndex] };
+			if (node.primitiveCount <= leafSize || depth >= BVH::MaxDepth)
+			{
+				node.bounds = {};
+				for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.primitiveCount; ++i)
+				{
+					node.bounds.Grow(primitiveBounds[primitives[i].index]);
+				}
+				return;
+			}
+
+			const uint32_t leftCount{ FindLinearSplit(primitives.data() + node.leftFirst, node.primitiveCount) };
+			const uint32_t leftIndex{ static_cast<uint32_t>(nodes.size()) };
+
+			BVHNode& leftChild{ nodes.emplace_back() };
+			leftChild.leftFirst = node.leftFirst;
+			leftChild.primitiveCount = leftCount;
+
+			BVHNode& rightChild{ nodes.emplace_back() };
+			rightChild.leftFirst = node.leftFirst + leftCount;
+			rightChild.primitiveCount = node.primitiveCount - leftCount;
+
+			node.leftFirst = leftIndex;
+			node.primitiveCount = 0;
+
+			SubdivideLinear(nodes, leftIndex, primitives, primitiveBounds, leafSize, depth + 1);
+			SubdivideLinear(nodes, leftIndex + 1, primitives, primitiveBounds, leafSize, depth + 1);
+
+			node.bounds = leftChild.bounds;
+			node.bounds.Grow(rightChild.bounds);
+		}
+
+		template<typename Key>
+		void BuildLinearTree(const std::vector<AABB>& primitiveBounds, uint32_t leafSize, ThreadPool* pThreadPool, std::vector<BVHNode>& nodes, std::vector<uint32_t>& primitiveIndices)
+		{
+			const uint32_t primitiveCount{ static_cast<uint32_t>(primitiveBounds.size()) };
+			const uint32_t blockCount{ GetBlockCount(primitiveCount) };
+
+			//Centroid bounds, every block grows its own
+			std::vector<Vector3> centroids(primitiveCount);
+			std::vector<AABB> blockCentroidBounds(blockCount);
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const uint32_t end{ std::min((block + 1) * BlockSize, primitiveCount) };
+					for (uint32_t i{ block * BlockSize }; i < end; ++i)
+					{
+						centroids[i] = primitiveBounds[i].GetCenter();
+						blockCentroidBounds[block].Grow(centroids[i]);
+					}
+				});
+
+			AABB centroidBounds{};
+			for (const AABB& bounds : blockCentroidBounds)
+			{
+				centroidBounds.Grow(bounds);
+			}
+
+			//Cells per unit on every axis, a flat axis keeps every centroid in cell 0
+			constexpr float cellCount{ sizeof(Key) == 4 ? 1024.f : 2097152.f };
+			const Vector3 extent{ centroidBounds.max - centroidBounds.min };
+			const Vector3 cellScale{
+				extent.x > 0.f ? cellCount / extent.x : 0.f,
+				extent.y > 0.f ? cellCount / extent.y : 0.f,
+				extent.z > 0.f ? cellCount / extent.z : 0.f };
+
+			std::vector<MortonPrimitive<Key>> primitives(primitiveCount);
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const uint32_t end{ std::min((block + 1) * BlockSize, primitiveCount) };
+					for (uint32_t i{ block * BlockSize }; i < end; ++i)
+					{
+						primitives[i] = { GetMortonCode<Key>(centroids[i], centroidBounds.min, cellScale), i };
+					}
+				});
+
+			RadixSort(primitives, pThreadPool);
+
+			//Split the top of the tree here, every split is one binary search. Parents come before their children,
+			//so the bounds of these nodes can be set back to front once the subtrees are done
+			nodes.reserve(primitiveBounds.size() * 2 - 1);
+			nodes.push_back({ {}, 0, primitiveCount });
+
+			std::vector<std::pair<uint32_t, uint32_t>> subtrees{};
+			std::vector<uint32_t> topNodes{};
+			std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 1u } };
+			while (!stack.empty())
+			{
+				const auto [nodeIndex, depth] { stack.back() };
+				stack.pop_back();
+
+				BVHNode& node{ nodes[nodeIndex] };
+				if (node.primitiveCount <= BVH::SubtreeSize || depth >= BVH::MaxDepth)
+				{
+					subtrees.emplace_back(nodeIndex, depth);
+					continue;
+				}
+
+				const uint32_t leftCount{ FindLinearSplit(primitives.data() + node.leftFirst, node.primitiveCount) };
+				const uint32_t leftIndex{ static_cast<uint32_t>(nodes.size()) };
+				const BVHNode leftChild{ {}, node.leftFirst, leftCount };
+				const BVHNode rightChild{ {}, node.leftFirst + leftCount, node.primitiveCount - leftCount };
+
+				node.leftFirst = leftIndex;
+				node.primitiveCount = 0;
+				nodes.push_back(leftChild);
+				nodes.push_back(rightChild);
+
+				topNodes.push_back(nodeIndex);
+				stack.emplace_back(leftIndex + 1, depth + 1);
+				stack.emplace_back(leftIndex, depth + 1);
+			}
+
+			AppendSubtrees(nodes, subtrees, pThreadPool, [&](std::vector<BVHNode>& subtreeNodes, uint32_t depth)
+				{
+					SubdivideLinear(subtreeNodes, 0, primitives, primitiveBounds, leafSize, depth);
+				});
+
+			for (auto it{ topNodes.rbegin() }; it != topNodes.rend(); ++it)
+			{
+				BVHNode& node{ nodes[*it] };
+				node.bounds = nodes[node.leftFirst].bounds;
+				node.bounds.Grow(nodes[node.leftFirst + 1].bounds);
+			}
+
+			primitiveIndices.resize(primitiveCount);
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const uint32_t end{ std::min((block + 1) * BlockSize, primitiveCount) };
+					for (uint32_t i{ block * BlockSize }; i < end; ++i)
+					{
+						primitiveIndices[i] = primitives[i].index;
+					}
+				});
+		}
+#pragma endregion
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, uint32_t batchSize, ThreadPool* pThreadPool)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		m_BatchSize = std::max(batchSize, 1u);
+		m_Nodes.clear();
+		m_PrimitiveIndices.resize(primitiveBounds.size());
+
+		if (primitiveBounds.empty())
+		{
+			CollapseWideNodes();
+			UpdateBuildStatistics(0.0);
+			return;
+		}
+
+		const uint32_t primitiveCount{ static_cast<uint32_t>(primitiveBounds.size()) };
+		const uint32_t blockCount{ GetBlockCount(primitiveCount) };
+
+		//Build records and root bounds, every block grows its own bounds
+		std::vector<BuildPrimitive> primitives(primitiveCount);
+		std::vector<AABB> blockBounds(blockCount);
+		ForEach(pThreadPool, blockCount, [&](uint32_t block)
+			{
+				const uint32_t end{ std::min((block + 1) * BlockSize, primitiveCount) };
+				for (uint32_t i{ block * BlockSize }; i < end; ++i)
+				{
+					primitives[i] = { primitiveBounds[i], primitiveBounds[i].GetCenter(), i };
+					blockBounds[block].Grow(primitiveBounds[i]);
+				}
+			});
+
+		//A binary tree with N leaves never has more than 2N - 1 nodes, so node references stay valid during the build
+		m_Nodes.reserve(primitiveBounds.size() * 2 - 1);
+
+		BVHNode& root{ m_Nodes.emplace_back() };
+		root.leftFirst = 0;
+		root.primitiveCount = primitiveCount;
+		for (const AABB& bounds : blockBounds)
+		{
+			root.bounds.Grow(bounds);
+		}
+
+		const std::vector<std::pair<uint32_t, uint32_t>> subtrees{ SubdivideTop(primitives, pThreadPool) };
+		AppendSubtrees(m_Nodes, subtrees, pThreadPool, [&](std::vector<BVHNode>& nodes, uint32_t depth)
+			{
+				Subdivide(nodes, 0, primitives, depth);
+			});
+
+		ForEach(pThreadPool, blockCount, [&](uint32_t block)
+			{
+				const uint32_t end{ std::min((block + 1) * BlockSize, primitiveCount) };
+				for (uint32_t i{ block * BlockSize }; i < end; ++i)
+				{
+					m_PrimitiveIndices[i] = primitives[i].index;
+				}
+			});
+
+		m_Nodes.shrink_to_fit();
+		CollapseWideNodes();
+
+		UpdateBuildStatistics(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	void BVH::BuildLinear(const std::vector<AABB>& primitiveBounds, uint32_t batchSize, ThreadPool* pThreadPool)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		m_BatchSize = std::max(batchSize, 1u);
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+
+		if (primitiveBounds.size() > MaxMorton30Count)
+			BuildLinearTree<uint64_t>(primitiveBounds, m_BatchSize, pThreadPool, m_Nodes, m_PrimitiveIndices);
+		else if (!primitiveBounds.empty())
+			BuildLinearTree<uint32_t>(primitiveBounds, m_BatchSize, pThreadPool, m_Nodes, m_PrimitiveIndices);
+
+		m_Nodes.shrink_to_fit();
+		CollapseWideNodes();
+
+		UpdateBuildStatistics(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	void BVH::Build(BVHBuilder builder, const std::vector<AABB>& primitiveBounds, uint32_t batchSize, ThreadPool* pThreadPool)
+	{
+		if (builder == BVHBuilder::Linear)
+			BuildLinear(primitiveBounds, batchSize, pThreadPool);
+		else
+			Build(primitiveBounds, batchSize, pThreadPool);
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		assert(primitiveBounds.size() == m_PrimitiveIndices.size() && "Refit needs the primitives the BVH was built for");
+
+		const auto start{ std::chrono::steady_clock::now() };
+
+		//Both builders store children after their parent, so back to front visits the children first
+		double cost{};
+		for (size_t nodeIndex{ m_Nodes.size() }; nodeIndex-- > 0;)
+		{
+			BVHNode& node{ m_Nodes[nodeIndex] };
+			if (node.IsLeaf())
+			{
+				node.bounds = {};
+				for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.primitiveCount; ++i)
+				{
+					node.bounds.Grow(primitiveBounds[m_PrimitiveIndices[i]]);
+				}
+				cost += double(GetBatchCount(node.primitiveCount)) * node.bounds.GetHalfArea();
+				continue;
+			}
+
+			assert(node.leftFirst > nodeIndex && "Children have to follow their parent");
+			node.bounds = m_Nodes[node.leftFirst].bounds;
+			node.bounds.Grow(m_Nodes[node.leftFirst + 1].bounds);
+			cost += node.bounds.GetHalfArea();
+		}
+
+		if (!m_Nodes.empty())
+		{
+			const float rootArea{ m_Nodes[0].bounds.GetHalfArea() };
+			m_BuildStatistics.sahCost = rootArea > 0.f ? static_cast<float>(cost / rootArea) : 0.f;
+		}
+		RefitWideNodes();
+
+		++m_BuildStatistics.refitCount;
+		m_BuildStatistics.refitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void BVH::Assign(std::vector<BVHNode>&& nodes, std::vector<uint32_t>&& primitiveIndices, uint32_t batchSize)
+	{
+		m_Nodes = std::move(nodes);
+		m_PrimitiveIndices = std::move(primitiveIndices);
+		m_BatchSize = std::max(batchSize, 1u);
+
+		CollapseWideNodes();
+		UpdateBuildStatistics(0.0);
+	}
+
+	void BVHWideNode::SetChild(uint32_t slot, const AABB& bounds, uint32_t child, uint32_t primitiveCount)
+	{
+		minX[slot] = bounds.min.x;
+		minY[slot] = bounds.min.y;
+		minZ[slot] = bounds.min.z;
+		maxX[slot] = bounds.max.x;
+		maxY[slot] = bounds.max.y;
+		maxZ[slot] = bounds.max.z;
+		children[slot] = child;
+		primitiveCounts[slot] = primitiveCount;
+	}
+
+	void BVH::Bins::Add(const Bins& other)
+	{
+		for (int axis{}; axis < 3; ++axis)
+		{
+			for (uint32_t i{}; i < BinCount; ++i)
+			{
+				bins[axis][i].bounds.Grow(other.bins[axis][i].bounds);
+				bins[axis][i].primitiveCount += other.bins[axis][i].primitiveCount;
+			}
+		}
+	}
+
+	uint32_t BVH::Split::GetBin(const Vector3& centroid) const
+	{
+		return std::min(BinCount - 1, static_cast<uint32_t>((centroid[axis] - centroidMin) * binScale));
+	}
+
+	//Splitting is only worth it when testing both children (one box test each, costed like one batch)
+	//is cheaper than intersecting every primitive batch in this node
+	bool BVH::IsSplitWorthIt(const BVHNode& node, const Split& split) const
+	{
+		const float nodeArea{ node.bounds.GetHalfArea() };
+		const float leafCost{ GetBatchCount(node.primitiveCount) * nodeArea };
+		return nodeArea + split.cost < leafCost;
+	}
+
+	void BVH::Subdivide(std::vector<BVHNode>& nodes, uint32_t nodeIndex, std::vector<BuildPrimitive>& primitives, uint32_t depth) const
+	{
+		BVHNode& node{ nodes[nodeIndex] };
+		if (node.primitiveCount <= 1 || depth >= MaxDepth)
+			return;
+
+		BuildPrimitive* pPrimitives{ primitives.data() + node.leftFirst };
+
+		//Bin on the centroid bounds, not on the node bounds, so large primitives do not leave most bins empty
+		AABB centroidBounds{};
+		for (uint32_t i{}; i < node.primitiveCount; ++i)
+		{
+			centroidBounds.Grow(pPrimitives[i].centroid);
+		}
+
+		Bins bins{};
+		BinPrimitives(pPrimitives, node.primitiveCount, centroidBounds, bins);
+
+		const Split split{ FindBestSplit(bins, centroidBounds) };
+		if (!IsSplitWorthIt(node, split))
+			return;
+
+		//Partition the primitives in place, using the same bin mapping as the split search
+		BuildPrimitive* pRight{ std::partition(pPrimitives, pPrimitives + node.primitiveCount, [&split](const BuildPrimitive& primitive)
+			{
+				return split.GetBin(primitive.centroid) < split.bin;
+			}) };
+
+		const uint32_t leftCount{ static_cast<uint32_t>(pRight - pPrimitives) };
+		if (leftCount == 0 || leftCount == node.primitiveCount)
+			return;
+
+		const uint32_t leftIndex{ static_cast<uint32_t>(nodes.size()) };
+		const uint32_t rightIndex{ leftIndex + 1 };
+
+		BVHNode& leftChild{ nodes.emplace_back() };
+		leftChild.leftFirst = node.leftFirst;
+		leftChild.primitiveCount = leftCount;
+
+		BVHNode& rightChild{ nodes.emplace_back() };
+		rightChild.leftFirst = node.leftFirst + leftCount;
+		rightChild.primitiveCount = node.primitiveCount - leftCount;
+
+		node.leftFirst = leftIndex;
+		node.primitiveCount = 0;
+
+		SetChildBounds(bins, split, leftChild, rightChild);
+
+		Subdivide(nodes, leftIndex, primitives, depth + 1);
+		Subdivide(nodes, rightIndex, primitives, depth + 1);
+	}
+
+	//One pass over the primitives for all three axes. A flat axis (every centroid in one plane) puts everything
+	//in its first bin, FindBestSplit skips it
+	void BVH::BinPrimitives(const BuildPrimitive* pPrimitives, uint32_t count, const AABB& centroidBounds, Bins& bins)
+	{
+		float scales[3]{};
+		for (int axis{}; axis < 3; ++axis)
+		{
+			const float boundsMin{ centroidBounds.min[axis] };
+			const float boundsMax{ centroidBounds.max[axis] };
+			if (boundsMin != boundsMax)
+				scales[axis] = BinCount / (boundsMax - boundsMin);
+		}
+
+#if defined(DAE_SIMD_X86)
+		//Bin bounds in SSE registers, a min and max per bin instead of six dependent scalar read-modify-writes
+		__m128 binMins[3][BinCount];
+		__m128 binMaxs[3][BinCount];
+		for (int axis{}; axis < 3; ++axis)
+		{
+			for (uint32_t bin{}; bin < BinCount; ++bin)
+			{
+				binMins[axis][bin] = _mm_set1_ps(FLT_MAX);
+				binMaxs[axis][bin] = _mm_set1_ps(-FLT_MAX);
+			}
+		}
+
+		for (uint32_t i{}; i < count; ++i)
+		{
+			const BuildPrimitive& primitive{ pPrimitives[i] };
+
+			//The fourth lanes hold max.x and centroid.x, they are never stored back
+			const __m128 primitiveMin{ _mm_loadu_ps(&primitive.bounds.min.x) };
+			const __m128 primitiveMax{ _mm_loadu_ps(&primitive.bounds.max.x) };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				const uint32_t bin{ std::min(BinCount - 1, static_cast<uint32_t>((primitive.centroid[axis] - centroidBounds.min[axis]) * scales[axis])) };
+				++bins.bins[axis][bin].primitiveCount;
+				binMins[axis][bin] = _mm_min_ps(binMins[axis][bin], primitiveMin);
+				binMaxs[axis][bin] = _mm_max_ps(binMaxs[axis][bin], primitiveMax);
+			}
+		}
+
+		for (int axis{}; axis < 3; ++axis)
+		{
+			for (uint32_t bin{}; bin < BinCount; ++bin)
+			{
+				alignas(16) float binMin[4];
+				alignas(16) float binMax[4];
+				_mm_store_ps(binMin, binMins[axis][bin]);
+				_mm_store_ps(binMax, binMaxs[axis][bin]);
+				bins.bins[axis][bin].bounds.Grow(AABB{ { binMin[0], binMin[1], binMin[2] }, { binMax[0], binMax[1], binMax[2] } });
+			}
+		}
+#else
+		for (uint32_t i{}; i < count; ++i)
+		{
+			const BuildPrimitive& primitive{ pPrimitives[i] };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				const uint32_t bin{ std::min(BinCount - 1, static_cast<uint32_t>((primitive.centroid[axis] - centroidBounds.min[axis]) * scales[axis])) };
+				++bins.bins[axis][bin].primitiveCount;
+				bins.bins[axis][bin].bounds.Grow(primitive.bounds);
+			}
+		}
+#endif
+	}
+
+	void BVH::SetChildBounds(const Bins& bins, const Split& split, BVHNode& leftChild, BVHNode& rightChild)
+	{
+		for (uint32_t i{}; i < BinCount; ++i)
+		{
+			(i < split.bin ? leftChild : rightChild).bounds.Grow(bins.bins[split.axis][i].bounds);
+		}
+	}
+
+	BVH::Split BVH::FindBestSplit(const Bins& bins, const AABB& centroidBounds) const
+	{
+		Split bestSplit{};
+		for (int axis{}; axis < 3; ++axis)
+		{
+			const float boundsMin{ centroidBounds.min[axis] };
+			const float boundsMax{ centroidBounds.max[axis] };
+			if (boundsMin == boundsMax)
+				continue;
+
+			const Bin* pBins{ bins.bins[axis] };
+
+			//Sweep from both sides to gather the area and count left and right of every bin boundary
+			float leftArea[BinCount - 1]{};
+			float rightArea[BinCount - 1]{};
+			uint32_t leftCount[BinCount - 1]{};
+			uint32_t rightCount[BinCount - 1]{};
+
+			AABB leftBounds{};
+			AABB rightBounds{};
+			uint32_t leftSum{};
+			uint32_t rightSum{};
+			for (uint32_t i{}; i < BinCount - 1; ++i)
+			{
+				leftSum += pBins[i].primitiveCount;
+				leftCount[i] = leftSum;
+				leftBounds.Grow(pBins[i].bounds);
+				leftArea[i] = leftBounds.GetHalfArea();
+
+				rightSum += pBins[BinCount - 1 - i].primitiveCount;
+				rightCount[BinCount - 2 - i] = rightSum;
+				rightBounds.Grow(pBins[BinCount - 1 - i].bounds);
+				rightArea[BinCount - 2 - i] = rightBounds.GetHalfArea();
+			}
+
+			for (uint32_t i{}; i < BinCount - 1; ++i)
+			{
+				if (leftCount[i] == 0 || rightCount[i] == 0)
+					continue;
+
+				const float cost{ GetBatchCount(leftCount[i]) * leftArea[i] + GetBatchCount(rightCount[i]) * rightArea[i] };
+				if (cost < bestSplit.cost)
+				{
+					bestSplit.cost = cost;
+					bestSplit.axis = axis;
+					bestSplit.bin = i + 1;
+					bestSplit.centroidMin = boundsMin;
+					bestSplit.binScale = BinCount / (boundsMax - boundsMin);
+				}
+			}
+		}
+
+		return bestSplit;
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> BVH::SubdivideTop(std::vector<BuildPrimitive>& primitives, ThreadPool* pThreadPool)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> subtrees{};
+		std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 1u } };
+
+		std::vector<AABB> blockCentroidBounds{};
+		std::vector<Bins> blockBins{};
+		std::vector<uint32_t> blockLeftCounts{};
+		std::vector<BuildPrimitive> partitionedPrimitives{};
+
+		while (!stack.empty())
+		{
+			const auto [nodeIndex, depth] { stack.back() };
+			stack.pop_back();
+
+			const BVHNode node{ m_Nodes[nodeIndex] };
+			if (node.primitiveCount <= SubtreeSize || depth >= MaxDepth)
+			{
+				subtrees.emplace_back(nodeIndex, depth);
+				continue;
+			}
+
+			//Every block of the node bins its primitives on its own, the blocks are merged afterwards
+			const uint32_t blockCount{ GetBlockCount(node.primitiveCount) };
+			const auto getBlockRange{ [&node](uint32_t block)
+				{
+					const uint32_t first{ node.leftFirst + block * BlockSize };
+					return std::pair<uint32_t, uint32_t>{ first, std::min(first + BlockSize, node.leftFirst + node.primitiveCount) };
+				} };
+
+			blockCentroidBounds.assign(blockCount, AABB{});
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const auto [first, end] { getBlockRange(block) };
+					for (uint32_t i{ first }; i < end; ++i)
+					{
+						blockCentroidBounds[block].Grow(primitives[i].centroid);
+					}
+				});
+
+			AABB centroidBounds{};
+			for (const AABB& bounds : blockCentroidBounds)
+			{
+				centroidBounds.Grow(bounds);
+			}
+
+			blockBins.assign(blockCount, Bins{});
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const auto [first, end] { getBlockRange(block) };
+					BinPrimitives(primitives.data() + first, end - first, centroidBounds, blockBins[block]);
+				});
+
+			Bins bins{};
+			for (const Bins& currentBins : blockBins)
+			{
+				bins.Add(currentBins);
+			}
+
+			const Split split{ FindBestSplit(bins, centroidBounds) };
+			if (!IsSplitWorthIt(node, split))
+				continue;
+
+			//Stable partition: count the left primitives of every block, then every block moves its primitives
+			//to their place behind the ones of the blocks before it
+			blockLeftCounts.assign(blockCount, 0);
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const auto [first, end] { getBlockRange(block) };
+					for (uint32_t i{ first }; i < end; ++i)
+					{
+						blockLeftCounts[block] += split.GetBin(primitives[i].centroid) < split.bin;
+					}
+				});
+
+			std::vector<uint32_t> blockLeftOffsets(blockCount);
+			const uint32_t leftCount{ std::accumulate(blockLeftCounts.begin(), blockLeftCounts.end(), 0u) };
+			if (leftCount == 0 || leftCount == node.primitiveCount)
+				continue;
+
+			std::exclusive_scan(blockLeftCounts.begin(), blockLeftCounts.end(), blockLeftOffsets.begin(), 0u);
+
+			partitionedPrimitives.resize(node.primitiveCount);
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const auto [first, end] { getBlockRange(block) };
+					uint32_t left{ blockLeftOffsets[block] };
+					uint32_t right{ leftCount + (first - node.leftFirst) - blockLeftOffsets[block] };
+					for (uint32_t i{ first }; i < end; ++i)
+					{
+						if (split.GetBin(primitives[i].centroid) < split.bin)
+							partitionedPrimitives[left++] = primitives[i];
+						else
+							partitionedPrimitives[right++] = primitives[i];
+					}
+				});
+
+			ForEach(pThreadPool, blockCount, [&](uint32_t block)
+				{
+					const auto [first, end] { getBlockRange(block) };
+					std::copy(partitionedPrimitives.begin() + (first - node.leftFirst), partitionedPrimitives.begin() + (end - node.leftFirst), primitives.begin() + first);
+				});
+
+			const uint32_t leftIndex{ static_cast<uint32_t>(m_Nodes.size()) };
+			const uint32_t rightIndex{ leftIndex + 1 };
+
+			BVHNode& leftChild{ m_Nodes.emplace_back() };
+			leftChild.leftFirst = node.leftFirst;
+			leftChild.primitiveCount = leftCount;
+
+			BVHNode& rightChild{ m_Nodes.emplace_back() };
+			rightChild.leftFirst = node.leftFirst + leftCount;
+			rightChild.primitiveCount = node.primitiveCount - leftCount;
+
+			SetChildBounds(bins, split, leftChild, rightChild);
+
+			m_Nodes[nodeIndex].leftFirst = leftIndex;
+			m_Nodes[nodeIndex].primitiveCount = 0;
+
+			stack.emplace_back(rightIndex, depth + 1);
+			stack.emplace_back(leftIndex, depth + 1);
+		}
+
+		return subtrees;
+	}
+
+	void BVH::CollapseWideNodes()
+	{
+		m_WideNodes.clear();
+		m_WideNodeSources.clear();
+		if (m_Nodes.empty())
+			return;
+
+		m_WideNodes.emplace_back();
+		m_WideNodeSources.resize(BVHWideNode::Width);
+
+		//Wide node to fill and the binary node whose subtree it replaces. A leaf root becomes a node with one child
+		std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 0u } };
+		while (!stack.empty())
+		{
+			const auto [wideIndex, nodeIndex] { stack.back() };
+			stack.pop_back();
+
+			uint32_t children[BVHWideNode::Width]{ nodeIndex };
+			uint32_t childCount{ 1 };
+			while (childCount < BVHWideNode::Width)
+			{
+				uint32_t largest{ UINT32_MAX };
+				float largestArea{ -1.f };
+				for (uint32_t i{}; i < childCount; ++i)
+				{
+					const BVHNode& child{ m_Nodes[children[i]] };
+					if (!child.IsLeaf() && child.bounds.GetHalfArea() > largestArea)
+					{
+						largest = i;
+						largestArea = child.bounds.GetHalfArea();
+					}
+				}
+
+				if (largest == UINT32_MAX)
+					break;
+
+				const uint32_t leftIndex{ m_Nodes[children[largest]].leftFirst };
+				children[largest] = leftIndex;
+				children[childCount++] = leftIndex + 1;
+			}
+
+			for (uint32_t slot{}; slot < childCount; ++slot)
+			{
+				m_WideNodeSources[wideIndex * BVHWideNode::Width + slot] = children[slot];
+
+				const BVHNode& child{ m_Nodes[children[slot]] };
+				if (child.IsLeaf())
+				{
+					m_WideNodes[wideIndex].SetChild(slot, child.bounds, child.leftFirst, child.primitiveCount);
+					continue;
+				}
+
+				const uint32_t childWideIndex{ static_cast<uint32_t>(m_WideNodes.size()) };
+				m_WideNodes.emplace_back();
+				m_WideNodeSources.resize(m_WideNodes.size() * BVHWideNode::Width);
+				m_WideNodes[wideIndex].SetChild(slot, child.bounds, childWideIndex, 0);
+				stack.emplace_back(childWideIndex, children[slot]);
+			}
+		}
+	}
+
+	void BVH::RefitWideNodes()
+	{
+		for (size_t wideIndex{}; wideIndex < m_WideNodes.size(); ++wideIndex)
+		{
+			BVHWideNode& node{ m_WideNodes[wideIndex] };
+			for (uint32_t slot{}; slot < BVHWideNode::Width && node.children[slot] != BVHWideNode::EmptyChild; ++slot)
+			{
+				const BVHNode& source{ m_Nodes[m_WideNodeSources[wideIndex * BVHWideNode::Width + slot]] };
+				node.SetChild(slot, source.bounds, node.children[slot], node.primitiveCounts[slot]);
+			}
+		}
+	}
+
+	void BVH::UpdateBuildStatistics(double buildTime)
+	{
+		m_BuildStatistics = {};
+		m_BuildStatistics.buildTime = buildTime;
+		m_BuildStatistics.nodeCount = static_cast<uint32_t>(m_Nodes.size());
+		m_BuildStatistics.wideNodeCount = static_cast<uint32_t>(m_WideNodes.size());
+		if (m_Nodes.empty())
+			return;
+
+		double cost{};
+		std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 1u } };
+		while (!stack.empty())
+		{
+			const auto [nodeIndex, depth] { stack.back() };
+			stack.pop_back();
+
+			const BVHNode& node{ m_Nodes[nodeIndex] };
+			m_BuildStatistics.depth = std::max(m_BuildStatistics.depth, depth);
+			if (node.IsLeaf())
+			{
+				++m_BuildStatistics.leafCount;
+				cost += double(GetBatchCount(node.primitiveCount)) * node.bounds.GetHalfArea();
+				continue;
+			}
+
+			cost += node.bounds.GetHalfArea();
+			stack.emplace_back(node.leftFirst, depth + 1);
+			stack.emplace_back(node.leftFirst + 1, depth + 1);
+		}
+
+		const float rootArea{ m_Nodes[0].bounds.GetHalfArea() };
+		m_BuildStatistics.sahCost = rootArea > 0.f ? static_cast<float>(cost / rootArea) : 0.f;
+		m_BuildStatistics.builtSahCost = m_BuildStatistics.sahCost;
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+#pragma region AABB
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		//Per component: a whole Vector3 store is split in 8 + 4 bytes, which stalls the next Grow of the
+		//same box (the builder's bins) when it loads the components one by one
+		void Grow(const Vector3& point)
+		{
+			min.x = std::min(min.x, point.x);
+			min.y = std::min(min.y, point.y);
+			min.z = std::min(min.z, point.z);
+			max.x = std::max(max.x, point.x);
+			max.y = std::max(max.y, point.y);
+			max.z = std::max(max.z, point.z);
+		}
+
+		//Union per axis, growing by an empty box (e.g. an empty bin) leaves the bounds as they are
+		void Grow(const AABB& bounds)
+		{
+			min.x = std::min(min.x, bounds.min.x);
+			min.y = std::min(min.y, bounds.min.y);
+			min.z = std::min(min.z, bounds.min.z);
+			max.x = std::max(max.x, bounds.max.x);
+			max.y = std::max(max.y, bounds.max.y);
+			max.z = std::max(max.z, bounds.max.z);
+		}
+
+		Vector3 GetCenter() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		//Half of the surface area, the factor 2 cancels out in every SAH comparison
+		float GetHalfArea() const
+		{
+			const Vector3 extent{ max - min };
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+	};
+#pragma endregion
+
+#pragma region BVH
+	struct BVHNode
+	{
+		AABB bounds{};
+		uint32_t leftFirst{}; //Interior: index of the left child (right child = leftFirst + 1), Leaf: first primitive
+		uint32_t primitiveCount{}; //0 for interior nodes
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	//Up to four children of the binary tree collapsed into one node, their boxes stored per component so a single
+	//SSE slab test covers all of them. Interior children are wide nodes themselves, leaves are primitive ranges
+	struct alignas(16) BVHWideNode
+	{
+		static constexpr uint32_t Width{ 4 };
+		static constexpr uint32_t EmptyChild{ UINT32_MAX };
+
+		float minX[Width]{};
+		float minY[Width]{};
+		float minZ[Width]{};
+		float maxX[Width]{};
+		float maxY[Width]{};
+		float maxZ[Width]{};
+		uint32_t children[Width]{ EmptyChild, EmptyChild, EmptyChild, EmptyChild }; //Interior: wide node index, Leaf: first primitive
+		uint32_t primitiveCounts[Width]{}; //0 for interior children and empty slots
+
+		void SetChild(uint32_t slot, const AABB& bounds, uint32_t child, uint32_t primitiveCount);
+	};
+
+	enum class BVHBuilder : uint32_t
+	{
+		SAH, //Binned surface area heuristic, the fastest traversal, for geometry that is built once
+		Linear //Morton code order (LBVH), builds several times faster but traverses slower, for geometry rebuilt every frame
+	};
+
+	//Quality and cost of the last build, to weigh build speed against trace speed
+	struct BVHBuildStatistics
+	{
+		double buildTime{}; //Milliseconds, 0 for a hierarchy taken over with Assign
+		uint32_t nodeCount{};
+		uint32_t leafCount{};
+		uint32_t wideNodeCount{}; //Nodes of the collapsed 4-wide tree
+		uint32_t depth{};
+		//Expected cost of a ray through the tree relative to one test of the root box: every interior node costs
+		//its area, every leaf its area per primitive batch (the cost model of the builder), over the root area
+		float sahCost{};
+		float builtSahCost{}; //sahCost right after the build, refits only change sahCost
+		uint32_t refitCount{}; //Since the build
+		double refitTime{}; //Milliseconds of the last refit
+
+		//How much worse the refit tree is than the one that was built, 1 right after a build
+		float GetDegradation() const { return builtSahCost > 0.f ? sahCost / builtSahCost : 1.f; }
+	};
+
+	//Binary bounding volume hierarchy built with the (binned) surface area heuristic, also kept collapsed into
+	//4-wide nodes for single rays (packets test their four rays against one box of the binary tree instead).
+	//Only stores indices, the primitives themselves stay with the owner (e.g. TriangleMesh)
+	class BVH final
+	{
+	public:
+		//Traversal keeps a fixed size stack, the builder never creates deeper trees
+		static constexpr uint32_t MaxDepth{ 64 };
+		//The wide tree is at most as deep, every wide node visited leaves at most Width - 1 more entries on the stack
+		static constexpr uint32_t MaxWideStackSize{ MaxDepth * (BVHWideNode::Width - 1) + 1 };
+		static constexpr uint32_t BinCount{ 16 };
+		//Nodes with more primitives are split with every thread binning and partitioning a part of them,
+		//smaller ones are the roots of subtrees that are built as a whole by one thread each
+		static constexpr uint32_t SubtreeSize{ 8192 };
+		//BuildLinear quantizes centroids to 10 bits per axis (30 bit codes) up to this many primitives, 21 bits
+		//(63 bit codes) above it, where too many primitives would share a cell and be split at their median
+		static constexpr uint32_t MaxMorton30Count{ 1u << 20 };
+		//Refit trees whose SAH cost grew by more than this factor since the build should be built again
+		static constexpr float MaxDegradation{ 1.5f };
+
+		/**
+		 * \brief Builds the hierarchy, replacing the previous one. The tree does not depend on the thread count.
+		 * \param primitiveBounds bounds of every primitive, indexed like the owner stores them
+		 * \param batchSize primitives a leaf intersects at once (SIMD width), leaves are sized in whole batches
+		 * \param pThreadPool threads to build with, nullptr builds on the calling thread
+		 */
+		void Build(const std::vector<AABB>& primitiveBounds, uint32_t batchSize = 1, ThreadPool* pThreadPool = nullptr);
+
+		/**
+		 * \brief Builds a linear BVH (LBVH), replacing the previous one: the primitives are sorted by the Morton code
+		 * of their centroid with a parallel radix sort, then every node splits its range where the highest differing
+		 * code bit flips. Same node layout as Build, the tree does not depend on the thread count either.
+		 * \param primitiveBounds bounds of every primitive, indexed like the owner stores them
+		 * \param batchSize primitives a leaf intersects at once (SIMD width), leaves hold at most one batch
+		 * \param pThreadPool threads to build with, nullptr builds on the calling thread
+		 */
+		void BuildLinear(const std::vector<AABB>& primitiveBounds, uint32_t batchSize = 1, ThreadPool* pThreadPool = nullptr);
+
+		//Build or BuildLinear
+		void Build(BVHBuilder builder, const std::vector<AABB>& primitiveBounds, uint32_t batchSize = 1, ThreadPool* pThreadPool = nullptr);
+
+		/**
+		 * \brief Fits the bounds of every node to the moved primitives, bottom up, keeping the tree and primitive order.
+		 * Costs O(nodes + primitives), but the tree gets worse the further the primitives moved (see NeedsRebuild).
+		 * \param primitiveBounds new bounds of the very primitives the hierarchy was built for, indexed the same way
+		 */
+		void Refit(const std::vector<AABB>& primitiveBounds);
+		//True when refits degraded the tree past MaxDegradation
+		bool NeedsRebuild() const { return m_BuildStatistics.GetDegradation() > MaxDegradation; }
+
+		//Takes over a hierarchy Build created before (e.g. loaded from a mesh cache) instead of building it again
+		void Assign(std::vector<BVHNode>&& nodes, std::vector<uint32_t>&& primitiveIndices, uint32_t batchSize);
+
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		//Root first, empty when the binary tree is
+		const std::vector<BVHWideNode>& GetWideNodes() const { return m_WideNodes; }
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+		uint32_t GetBatchSize() const { return m_BatchSize; }
+		uint32_t GetPrimitiveCount() const { return static_cast<uint32_t>(m_PrimitiveIndices.size()); }
+		const BVHBuildStatistics& GetBuildStatistics() const { return m_BuildStatistics; }
+		bool IsEmpty() const { return m_Nodes.empty(); }
+
+	private:
+		//What the builder sorts instead of the indices, so binning and partitioning read contiguous memory
+		struct BuildPrimitive
+		{
+			AABB bounds{};
+			Vector3 centroid{};
+			uint32_t index{};
+		};
+
+		struct Bin
+		{
+			AABB bounds{};
+			uint32_t primitiveCount{};
+		};
+
+		//Bins of all three axes over the centroid bounds of one node
+		struct Bins
+		{
+			Bin bins[3][BinCount]{};
+
+			void Add(const Bins& other);
+		};
+
+		struct Split
+		{
+			float cost{ FLT_MAX };
+			int axis{};
+			uint32_t bin{}; //First bin of the right child
+			float centroidMin{};
+			float binScale{};
+
+			uint32_t GetBin(const Vector3& centroid) const;
+		};
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<BVHWideNode> m_WideNodes{};
+		std::vector<uint32_t> m_WideNodeSources{}; //Binary node of every wide node slot (Width per node), for refits
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		uint32_t m_BatchSize{ 1 };
+		BVHBuildStatistics m_BuildStatistics{};
+
+		uint32_t GetBatchCount(uint32_t primitiveCount) const { return (primitiveCount + m_BatchSize - 1) / m_BatchSize; }
+		bool IsSplitWorthIt(const BVHNode& node, const Split& split) const;
+
+		void Subdivide(std::vector<BVHNode>& nodes, uint32_t nodeIndex, std::vector<BuildPrimitive>& primitives, uint32_t depth) const;
+		static void BinPrimitives(const BuildPrimitive* pPrimitives, uint32_t count, const AABB& centroidBounds, Bins& bins);
+		Split FindBestSplit(const Bins& bins, const AABB& centroidBounds) const;
+		//The children's bounds are the bins on their side of the split
+		static void SetChildBounds(const Bins& bins, const Split& split, BVHNode& leftChild, BVHNode& rightChild);
+
+		//Splits the nodes with more than SubtreeSize primitives, binning and partitioning in blocks on all threads.
+		//Returns the nodes left to subdivide, with their depth
+		std::vector<std::pair<uint32_t, uint32_t>> SubdivideTop(std::vector<BuildPrimitive>& primitives, ThreadPool* pThreadPool);
+
+		//Rebuilds m_WideNodes from m_Nodes: every wide node keeps opening its largest interior child until it has
+		//Width children, so the big boxes most rays enter are the ones skipped
+		void CollapseWideNodes();
+		//Copies the refit binary boxes into the wide nodes, keeping the collapse of the build
+		void RefitWideNodes();
+		void UpdateBuildStatistics(double buildTime);
+	};
+#pragma endregion
+}
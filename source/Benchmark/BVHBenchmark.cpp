@@ -0,0 +1,303 @@
+#include "BVHBenchmark.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+
+//Project includes
+#include "../BVH.h"
+#include "../DataTypes.h"
+#include "../ThreadPool.h"
+#include "../Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		struct Result
+		{
+			uint32_t triangleCount{};
+			BVHBuilder builder{};
+			uint32_t threadCount{};
+			std::vector<double> buildTimes{}; //Milliseconds, sorted
+			double meanBuildTime{};
+			double traceTime{}; //Milliseconds for all rays
+			uint32_t hitCount{}; //The same for every builder, or one of them built a broken tree
+			double meanRefitTime{}; //Milliseconds to refit the tree to the rotated mesh
+			float refitDegradation{}; //SAH cost of the refit tree over the cost of the built one
+			BVHBuildStatistics statistics{};
+			bool isSameTree{ true }; //Same nodes and primitive order as the first thread count of the builder
+		};
+
+		constexpr BVHBuilder Builders[]{ BVHBuilder::SAH, BVHBuilder::Linear };
+
+		const char* GetName(BVHBuilder builder)
+		{
+			return builder == BVHBuilder::Linear ? "linear" : "sah";
+		}
+
+		std::vector<uint32_t> GetDefaultThreadCounts()
+		{
+			const uint32_t hardwareThreads{ std::max(std::thread::hardware_concurrency(), 1u) };
+
+			std::vector<uint32_t> threadCounts{};
+			for (uint32_t threadCount{ 1 }; threadCount < hardwareThreads; threadCount *= 2)
+			{
+				threadCounts.push_back(threadCount);
+			}
+			threadCounts.push_back(hardwareThreads);
+			return threadCounts;
+		}
+
+		//Sphere with ripples, tessellated in rings so it has about triangleCount triangles
+		TriangleMesh CreateMesh(uint32_t triangleCount)
+		{
+			const uint32_t ringCount{ std::max(2u, static_cast<uint32_t>(std::sqrt(triangleCount / 4.0))) };
+			const uint32_t segmentCount{ std::max(3u, triangleCount / (ringCount * 2)) };
+
+			const auto getPoint{ [&](uint32_t ring, uint32_t segment)
+				{
+					const float theta{ PI * ring / ringCount };
+					const float phi{ PI_2 * segment / segmentCount };
+					const float radius{ 1.f + 0.05f * std::sin(theta * 37.f) * std::sin(phi * 23.f) };
+					return Vector3{ radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi) };
+				} };
+
+			TriangleMesh mesh{};
+			mesh.cullMode = TriangleCullMode::NoCulling;
+			mesh.positions.reserve(size_t(ringCount + 1) * (segmentCount + 1));
+			for (uint32_t ring{}; ring <= ringCount; ++ring)
+			{
+				for (uint32_t segment{}; segment <= segmentCount; ++segment)
+				{
+					mesh.positions.push_back(getPoint(ring, segment));
+				}
+			}
+
+			const auto getIndex{ [&](uint32_t ring, uint32_t segment)
+				{
+					return static_cast<int>(ring * (segmentCount + 1) + segment);
+				} };
+
+			mesh.indices.reserve(size_t(ringCount) * segmentCount * 6);
+			for (uint32_t ring{}; ring < ringCount; ++ring)
+			{
+				for (uint32_t segment{}; segment < segmentCount; ++segment)
+				{
+					const int i0{ getIndex(ring, segment) };
+					const int i1{ getIndex(ring + 1, segment) };
+					const int i2{ getIndex(ring + 1, segment + 1) };
+					const int i3{ getIndex(ring, segment + 1) };
+					mesh.indices.insert(mesh.indices.end(), { i0, i1, i2, i0, i2, i3 });
+				}
+			}
+
+			mesh.CalculateNormals();
+			mesh.TransformVertices();
+			return mesh;
+		}
+
+		//From a sphere around the mesh towards random points inside it, so most rays hit
+		std::vector<Ray> CreateRays(uint32_t rayCount)
+		{
+			std::mt19937 random{ 1234 };
+			std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+			const auto getPointInSphere{ [&]()
+				{
+					Vector3 point{};
+					do
+					{
+						point = { distribution(random), distribution(random), distribution(random) };
+					} while (point.SqrMagnitude() > 1.f);
+					return point;
+				} };
+
+			std::vector<Ray> rays(rayCount);
+			for (Ray& ray : rays)
+			{
+				ray.origin = getPointInSphere().Normalized() * 3.f;
+				ray.direction = (getPointInSphere() - ray.origin).Normalized();
+			}
+			return rays;
+		}
+
+		bool IsSameTree(const BVH& bvh, const BVH& other)
+		{
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const std::vector<BVHNode>& otherNodes{ other.GetNodes() };
+			return nodes.size() == otherNodes.size()
+				&& std::memcmp(nodes.data(), otherNodes.data(), nodes.size() * sizeof(BVHNode)) == 0
+				&& bvh.GetPrimitiveIndices() == other.GetPrimitiveIndices();
+		}
+
+		//Triangle bounds after a rotation of the mesh, what a refit gets for an animation step
+		std::vector<AABB> GetRotatedBounds(TriangleMesh& mesh)
+		{
+			mesh.RotateY(0.5f);
+			mesh.TransformVertices();
+			std::vector<AABB> triangleBounds{ mesh.GetTriangleBounds() };
+
+			mesh.RotateY(0.f);
+			mesh.TransformVertices();
+			return triangleBounds;
+		}
+
+		Result Measure(TriangleMesh& mesh, BVHBuilder builder, uint32_t threadCount, const std::vector<Ray>& rays, const std::vector<AABB>& rotatedBounds,
+			const BVH* pReference, const BVHBenchmark::Settings& settings)
+		{
+			ThreadPool threadPool{ threadCount };
+
+			Result result{};
+			result.triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+			result.builder = builder;
+			result.threadCount = threadPool.GetThreadCount();
+
+			mesh.bvhBuilder = builder;
+			for (uint32_t iteration{}; iteration < settings.iterations; ++iteration)
+			{
+				mesh.BuildBVH(&threadPool);
+				result.buildTimes.push_back(mesh.bvh.GetBuildStatistics().buildTime);
+			}
+			mesh.BuildTriangles();
+
+			std::vector<uint8_t> hits(rays.size());
+			const auto traceStart{ std::chrono::steady_clock::now() };
+			threadPool.ParallelFor(static_cast<uint32_t>(rays.size()), 256, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						HitRecord hitRecord{};
+						hits[i] = GeometryUtils::HitTest_TriangleMesh(mesh, rays[i], hitRecord);
+					}
+				});
+			result.traceTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - traceStart).count();
+			result.hitCount = static_cast<uint32_t>(std::count(hits.begin(), hits.end(), uint8_t{ 1 }));
+
+			result.statistics = mesh.bvh.GetBuildStatistics();
+			result.isSameTree = !pReference || IsSameTree(mesh.bvh, *pReference);
+
+			BVH refitBVH{ mesh.bvh };
+			for (uint32_t iteration{}; iteration < settings.iterations; ++iteration)
+			{
+				refitBVH.Refit(rotatedBounds);
+				result.meanRefitTime += refitBVH.GetBuildStatistics().refitTime / settings.iterations;
+			}
+			result.refitDegradation = refitBVH.GetBuildStatistics().GetDegradation();
+
+			result.meanBuildTime = std::accumulate(result.buildTimes.begin(), result.buildTimes.end(), 0.0) / result.buildTimes.size();
+			std::sort(result.buildTimes.begin(), result.buildTimes.end());
+			return result;
+		}
+
+		void WriteJson(std::ostream& output, const std::vector<Result>& results, const BVHBenchmark::Settings& settings)
+		{
+			output << "{\n";
+			output << "  \"suite\": \"bvh\",\n";
+			output << "  \"hardwareConcurrency\": " << std::thread::hardware_concurrency() << ",\n";
+			output << "  \"binCount\": " << BVH::BinCount << ",\n";
+			output << "  \"subtreeSize\": " << BVH::SubtreeSize << ",\n";
+			output << "  \"batchSize\": " << MaxSimdWidth << ",\n";
+			output << "  \"iterations\": " << settings.iterations << ",\n";
+			output << "  \"rays\": " << settings.rayCount << ",\n";
+			output << "  \"results\": [";
+
+			for (size_t i{}; i < results.size(); ++i)
+			{
+				const Result& result{ results[i] };
+
+				//Scaling against the single threaded build of the same mesh and builder, if there is one
+				const auto baseline{ std::find_if(results.begin(), results.end(), [&](const Result& other)
+					{
+						return other.triangleCount == result.triangleCount && other.builder == result.builder && other.threadCount == 1;
+					}) };
+
+				output << (i == 0 ? "\n" : ",\n");
+				output << "    {\n";
+				output << "      \"triangles\": " << result.triangleCount << ",\n";
+				output << "      \"builder\": \"" << GetName(result.builder) << "\",\n";
+				output << "      \"threads\": " << result.threadCount << ",\n";
+				output << "      \"msPerBuild\": " << result.meanBuildTime << ",\n";
+				output << "      \"minMs\": " << result.buildTimes.front() << ",\n";
+				output << "      \"maxMs\": " << result.buildTimes.back() << ",\n";
+				output << "      \"mtrianglesPerSecond\": " << result.triangleCount / (result.meanBuildTime * 1000.0) << ",\n";
+				output << "      \"traceMs\": " << result.traceTime << ",\n";
+				output << "      \"buildAndTraceMs\": " << result.meanBuildTime + result.traceTime << ",\n";
+				output << "      \"mraysPerSecond\": " << settings.rayCount / (result.traceTime * 1000.0) << ",\n";
+				output << "      \"hits\": " << result.hitCount << ",\n";
+				output << "      \"nodes\": " << result.statistics.nodeCount << ",\n";
+				output << "      \"leaves\": " << result.statistics.leafCount << ",\n";
+				output << "      \"wideNodes\": " << result.statistics.wideNodeCount << ",\n";
+				output << "      \"depth\": " << result.statistics.depth << ",\n";
+				output << "      \"sahCost\": " << result.statistics.sahCost << ",\n";
+				output << "      \"refitMs\": " << result.meanRefitTime << ",\n";
+				output << "      \"refitDegradation\": " << result.refitDegradation << ",\n";
+				output << "      \"sameTree\": " << (result.isSameTree ? "true" : "false");
+
+				if (baseline != results.end())
+				{
+					const double speedup{ baseline->meanBuildTime / result.meanBuildTime };
+					output << ",\n";
+					output << "      \"speedup\": " << speedup << ",\n";
+					output << "      \"scalingEfficiency\": " << speedup / result.threadCount;
+				}
+				output << "\n    }";
+			}
+
+			output << "\n  ]\n";
+			output << "}\n";
+		}
+	}
+
+	namespace BVHBenchmark
+	{
+		int Run(const Settings& settings)
+		{
+			const std::vector<uint32_t> threadCounts{ settings.threadCounts.empty() ? GetDefaultThreadCounts() : settings.threadCounts };
+			const std::vector<Ray> rays{ CreateRays(settings.rayCount) };
+
+			std::vector<Result> results{};
+			for (const uint32_t triangleCount : settings.triangleCounts)
+			{
+				TriangleMesh mesh{ CreateMesh(triangleCount) };
+				const std::vector<AABB> rotatedBounds{ GetRotatedBounds(mesh) };
+
+				for (const BVHBuilder builder : Builders)
+				{
+					//Every thread count has to build the tree of the first one
+					BVH reference{};
+					for (size_t i{}; i < threadCounts.size(); ++i)
+					{
+						results.push_back(Measure(mesh, builder, threadCounts[i], rays, rotatedBounds, i == 0 ? nullptr : &reference, settings));
+						if (i == 0)
+							reference = mesh.bvh;
+
+						const Result& result{ results.back() };
+						std::cout << result.triangleCount << " triangles, " << GetName(builder) << " @ " << result.threadCount << " thread(s): "
+							<< result.meanBuildTime << " ms/build, " << result.traceTime << " ms trace, " << result.statistics.nodeCount
+							<< " nodes, SAH cost " << result.statistics.sahCost << ", " << result.meanRefitTime << " ms/refit x"
+							<< result.refitDegradation << " cost"
+							<< (result.isSameTree ? "" : ", tree differs from the first thread count") << std::endl;
+					}
+				}
+			}
+
+			std::ofstream file{ settings.outputPath };
+			if (!file)
+			{
+				std::cout << "Could not write " << settings.outputPath << std::endl;
+				return 1;
+			}
+
+			WriteJson(file, results, settings);
+			std::cout << "Results written to " << settings.outputPath << std::endl;
+			return 0;
+		}
+	}
+}
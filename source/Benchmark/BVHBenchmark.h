@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	namespace BVHBenchmark
+	{
+		struct Settings
+		{
+			std::vector<uint32_t> triangleCounts{ 1u << 16, 1u << 18, 1u << 20 };
+			std::vector<uint32_t> threadCounts{}; //Empty: 1, 2, 4, ... up to the hardware concurrency
+			uint32_t iterations{ 5 }; //Builds per mesh, builder and thread count
+			uint32_t rayCount{ 1u << 18 }; //Rays traced through every built tree
+			std::string outputPath{ "BVHBenchmarkResults.json" };
+		};
+
+		/**
+		 * \brief Builds the BVH of generated meshes (a bumpy sphere, like a scanned object) with every builder at every
+		 * thread count, traces random rays through it and refits it to the rotated mesh. Writes build, trace and refit
+		 * times, node counts, SAH cost and how much the refit degraded it as JSON
+		 * \return 0 on success
+		 */
+		int Run(const Settings& settings);
+	}
+}
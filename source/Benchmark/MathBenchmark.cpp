@@ -0,0 +1,202 @@
+#include "MathBenchmark.h"
+
+//Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+//Project includes
+#include "../Matrix.h"
+#include "../Vector3.h"
+#include "OutOfLineMath.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Math through the constexpr header implementations, the compiler sees every body
+		struct InlineMath
+		{
+			static float Dot(const Vector3& v1, const Vector3& v2) { return Vector3::Dot(v1, v2); }
+			static Vector3 Cross(const Vector3& v1, const Vector3& v2) { return Vector3::Cross(v1, v2); }
+			static Vector3 Normalized(const Vector3& v) { return v.Normalized(); }
+			static Vector3 Subtract(const Vector3& v1, const Vector3& v2) { return v1 - v2; }
+			static Vector3 TransformVector(const Matrix& m, const Vector3& v) { return m.TransformVector(v); }
+		};
+
+		//Same math through calls into another translation unit
+		struct CallMath
+		{
+			static float Dot(const Vector3& v1, const Vector3& v2) { return OutOfLineMath::Dot(v1, v2); }
+			static Vector3 Cross(const Vector3& v1, const Vector3& v2) { return OutOfLineMath::Cross(v1, v2); }
+			static Vector3 Normalized(const Vector3& v) { return OutOfLineMath::Normalized(v); }
+			static Vector3 Subtract(const Vector3& v1, const Vector3& v2) { return OutOfLineMath::Subtract(v1, v2); }
+			static Vector3 TransformVector(const Matrix& m, const Vector3& v) { return OutOfLineMath::TransformVector(m, v); }
+		};
+
+		struct Input
+		{
+			std::vector<Vector3> origins{};
+			std::vector<Vector3> directions{};
+			std::vector<Vector3> v0{};
+			std::vector<Vector3> v1{};
+			std::vector<Vector3> v2{};
+			Matrix transform{};
+		};
+
+		//Sphere test of HitTest_Sphere, only the discriminant and the near root
+		template<typename TMath>
+		float SphereKernel(const Input& input)
+		{
+			const Vector3 sphereOrigin{ 0.f, 0.f, 10.f };
+			constexpr float radius{ 2.f };
+
+			float sum{};
+			for (size_t i{}; i < input.origins.size(); ++i)
+			{
+				const Vector3& d{ input.directions[i] };
+				const Vector3 oc{ TMath::Subtract(input.origins[i], sphereOrigin) };
+
+				const float a{ TMath::Dot(d, d) };
+				const float b{ TMath::Dot(d, oc) };
+				const float c{ TMath::Dot(oc, oc) - radius * radius };
+				const float discriminant{ b * b - a * c };
+				if (discriminant > 0.f)
+					sum += (-b - std::sqrt(discriminant)) / a;
+			}
+			return sum;
+		}
+
+		//Moller-Trumbore as in HitTest_Triangle
+		template<typename TMath>
+		float TriangleKernel(const Input& input)
+		{
+			float sum{};
+			for (size_t i{}; i < input.origins.size(); ++i)
+			{
+				const Vector3& d{ input.directions[i] };
+				const Vector3 edge1{ TMath::Subtract(input.v1[i], input.v0[i]) };
+				const Vector3 edge2{ TMath::Subtract(input.v2[i], input.v0[i]) };
+
+				const Vector3 p{ TMath::Cross(d, edge2) };
+				const float det{ TMath::Dot(edge1, p) };
+				if (std::abs(det) < 1e-8f)
+					continue;
+
+				const float invDet{ 1.f / det };
+				const Vector3 s{ TMath::Subtract(input.origins[i], input.v0[i]) };
+				const float u{ TMath::Dot(s, p) * invDet };
+				if (u < 0.f || u > 1.f)
+					continue;
+
+				const Vector3 q{ TMath::Cross(s, edge1) };
+				const float v{ TMath::Dot(d, q) * invDet };
+				if (v < 0.f || u + v > 1.f)
+					continue;
+
+				sum += TMath::Dot(edge2, q) * invDet;
+			}
+			return sum;
+		}
+
+		//Camera ray direction as in Renderer::Render
+		template<typename TMath>
+		float TransformKernel(const Input& input)
+		{
+			float sum{};
+			for (size_t i{}; i < input.directions.size(); ++i)
+			{
+				const Vector3 direction{ TMath::Normalized(TMath::TransformVector(input.transform, input.directions[i])) };
+				sum += direction.x + direction.y + direction.z;
+			}
+			return sum;
+		}
+
+		Input CreateInput(uint32_t count)
+		{
+			std::mt19937 generator{ 1234 };
+			std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+			const auto random = [&]() { return Vector3{ distribution(generator), distribution(generator), distribution(generator) }; };
+
+			Input input{};
+			input.origins.reserve(count);
+			input.directions.reserve(count);
+			input.v0.reserve(count);
+			input.v1.reserve(count);
+			input.v2.reserve(count);
+			for (uint32_t i{}; i < count; ++i)
+			{
+				input.origins.push_back(random());
+				input.directions.push_back((random() + Vector3::UnitZ * 2.f).Normalized());
+				input.v0.push_back(random() + Vector3::UnitZ * 5.f);
+				input.v1.push_back(random() + Vector3::UnitZ * 5.f);
+				input.v2.push_back(random() + Vector3::UnitZ * 5.f);
+			}
+			input.transform = Matrix::CreateRotation(0.3f, 0.7f, 0.1f) * Matrix::CreateTranslation(1.f, 2.f, 3.f);
+			return input;
+		}
+
+		//Best of several repetitions, in nanoseconds per element
+		template<typename TKernel>
+		double Measure(const Input& input, TKernel kernel, float& checksum)
+		{
+			constexpr int repetitions{ 5 };
+
+			double best{ DBL_MAX };
+			for (int r{}; r < repetitions; ++r)
+			{
+				const auto start{ std::chrono::steady_clock::now() };
+				checksum = kernel(input);
+				const auto end{ std::chrono::steady_clock::now() };
+
+				const double ns{ std::chrono::duration<double, std::nano>(end - start).count() };
+				best = std::min(best, ns / static_cast<double>(input.origins.size()));
+			}
+			return best;
+		}
+
+		template<typename TInlineKernel, typename TCallKernel>
+		bool Report(const char* name, const Input& input, TInlineKernel inlineKernel, TCallKernel callKernel)
+		{
+			float inlineChecksum{};
+			float callChecksum{};
+			const double inlineNs{ Measure(input, inlineKernel, inlineChecksum) };
+			const double callNs{ Measure(input, callKernel, callChecksum) };
+
+			std::cout << name
+				<< ": inline " << inlineNs << " ns/op"
+				<< ", out-of-line " << callNs << " ns/op"
+				<< ", speedup " << callNs / inlineNs << "x" << std::endl;
+
+			//Both variants have to compute the same thing, otherwise the timings mean nothing
+			const float tolerance{ 1e-3f * std::max(1.f, std::abs(inlineChecksum)) };
+			if (std::abs(inlineChecksum - callChecksum) > tolerance)
+			{
+				std::cout << name << ": checksum mismatch (" << inlineChecksum << " vs " << callChecksum << ")" << std::endl;
+				return false;
+			}
+			return true;
+		}
+	}
+
+	namespace MathBenchmark
+	{
+		int Run(uint32_t iterations)
+		{
+			const Input input{ CreateInput(iterations) };
+
+			std::cout << "Math micro-benchmark, " << iterations << " iterations per kernel" << std::endl;
+
+			bool isValid{ true };
+			isValid &= Report("Sphere", input, SphereKernel<InlineMath>, SphereKernel<CallMath>);
+			isValid &= Report("Triangle", input, TriangleKernel<InlineMath>, TriangleKernel<CallMath>);
+			isValid &= Report("Transform", input, TransformKernel<InlineMath>, TransformKernel<CallMath>);
+
+			return isValid ? 0 : 1;
+		}
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	namespace MathBenchmark
+	{
+		/**
+		 * \brief Times the sphere test, Moller-Trumbore and matrix transforms with the inline header math
+		 * against the same code calling out-of-line functions, and prints ns/op for both
+		 * \param iterations number of ray/primitive tests per kernel
+		 * \return 0 on success
+		 */
+		int Run(uint32_t iterations);
+	}
+}
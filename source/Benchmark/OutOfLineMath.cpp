@@ -0,0 +1,42 @@
+#include "OutOfLineMath.h"
+
+namespace dae
+{
+	namespace OutOfLineMath
+	{
+		float Dot(const Vector3& v1, const Vector3& v2)
+		{
+			return (v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z);
+		}
+
+		Vector3 Cross(const Vector3& v1, const Vector3& v2)
+		{
+			return {
+				(v1.y * v2.z) - (v1.z * v2.y),
+				(v1.z * v2.x) - (v1.x * v2.z),
+				(v1.x * v2.y) - (v1.y * v2.x) };
+		}
+
+		Vector3 Normalized(const Vector3& v)
+		{
+			const float m = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+			return { v.x / m, v.y / m, v.z / m };
+		}
+
+		Vector3 Subtract(const Vector3& v1, const Vector3& v2)
+		{
+			return { v1.x - v2.x, v1.y - v2.y, v1.z - v2.z };
+		}
+
+		Vector3 TransformVector(const Matrix& m, const Vector3& v)
+		{
+			const Vector4 xAxis{ m[0] };
+			const Vector4 yAxis{ m[1] };
+			const Vector4 zAxis{ m[2] };
+			return {
+				xAxis.x * v.x + yAxis.x * v.y + zAxis.x * v.z,
+				xAxis.y * v.x + yAxis.y * v.y + zAxis.y * v.z,
+				xAxis.z * v.x + yAxis.z * v.y + zAxis.z * v.z };
+		}
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "../Matrix.h"
+#include "../Vector3.h"
+
+namespace dae
+{
+	//Reference copies of the hot math functions compiled in their own translation unit.
+	//Without LTO every call stays a real call, which is what Vector3.cpp/Matrix.cpp used to cost.
+	namespace OutOfLineMath
+	{
+		float Dot(const Vector3& v1, const Vector3& v2);
+		Vector3 Cross(const Vector3& v1, const Vector3& v2);
+		Vector3 Normalized(const Vector3& v);
+		Vector3 Subtract(const Vector3& v1, const Vector3& v2);
+		Vector3 TransformVector(const Matrix& m, const Vector3& v);
+	}
+}
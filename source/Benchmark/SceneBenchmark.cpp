@@ -0,0 +1,204 @@
+#include "SceneBenchmark.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+//Project includes
+#include "../Renderer.h"
+#include "../Scene.h"
+#include "../Simd.h"
+#include "../Statistics.h"
+#include "../Timer.h"
+
+namespace dae
+{
+	namespace
+	{
+		struct Result
+		{
+			std::string sceneName{};
+			uint32_t threadCount{};
+			Camera camera{};
+			std::vector<double> frameTimes{}; //Milliseconds, sorted
+			double meanFrameTime{};
+			Statistics::Counters statistics{}; //Of the last frame, the camera does not move
+		};
+
+		//Nearest rank percentile of sorted values
+		double GetPercentile(const std::vector<double>& sortedValues, double percentile)
+		{
+			const size_t rank{ static_cast<size_t>(std::ceil(percentile / 100.0 * sortedValues.size())) };
+			return sortedValues[std::clamp<size_t>(rank, 1, sortedValues.size()) - 1];
+		}
+
+		std::vector<uint32_t> GetDefaultThreadCounts()
+		{
+			const uint32_t hardwareThreads{ std::max(std::thread::hardware_concurrency(), 1u) };
+
+			std::vector<uint32_t> threadCounts{};
+			for (uint32_t threadCount{ 1 }; threadCount < hardwareThreads; threadCount *= 2)
+			{
+				threadCounts.push_back(threadCount);
+			}
+			threadCounts.push_back(hardwareThreads);
+			return threadCounts;
+		}
+
+		std::string EscapeJson(const std::string& text)
+		{
+			std::string escaped{};
+			for (const char c : text)
+			{
+				if (c == '"' || c == '\\')
+					escaped += '\\';
+				escaped += c;
+			}
+			return escaped;
+		}
+
+		Result Measure(Scene* pScene, const std::string& sceneName, uint32_t threadCount, const SceneBenchmark::Settings& settings)
+		{
+			Renderer renderer{ settings.width, settings.height, threadCount };
+
+			for (uint32_t frame{}; frame < settings.warmupFrames; ++frame)
+			{
+				renderer.Render(pScene);
+			}
+
+			Result result{};
+			result.sceneName = sceneName;
+			result.threadCount = renderer.GetThreadCount();
+			result.camera = pScene->GetCamera();
+			result.frameTimes.reserve(settings.frameCount);
+
+			for (uint32_t frame{}; frame < settings.frameCount; ++frame)
+			{
+				const auto start{ std::chrono::steady_clock::now() };
+				renderer.Render(pScene);
+				const auto end{ std::chrono::steady_clock::now() };
+
+				result.frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			}
+
+			result.statistics = renderer.GetStatistics();
+			result.meanFrameTime = std::accumulate(result.frameTimes.begin(), result.frameTimes.end(), 0.0) / result.frameTimes.size();
+			std::sort(result.frameTimes.begin(), result.frameTimes.end());
+			return result;
+		}
+
+		void WriteJson(std::ostream& output, const std::vector<Result>& results, const SceneBenchmark::Settings& settings)
+		{
+			const double pixelCount{ double(settings.width) * settings.height };
+
+			output << "{\n";
+			output << "  \"suite\": \"scenes\",\n";
+			output << "  \"simdLevel\": \"" << Simd::ToString(Simd::GetLevel()) << "\",\n";
+			output << "  \"statisticsEnabled\": " << (Statistics::IsEnabled() ? "true" : "false") << ",\n";
+			output << "  \"hardwareConcurrency\": " << std::thread::hardware_concurrency() << ",\n";
+			output << "  \"width\": " << settings.width << ",\n";
+			output << "  \"height\": " << settings.height << ",\n";
+			output << "  \"warmupFrames\": " << settings.warmupFrames << ",\n";
+			output << "  \"frameCount\": " << settings.frameCount << ",\n";
+			output << "  \"results\": [";
+
+			for (size_t i{}; i < results.size(); ++i)
+			{
+				const Result& result{ results[i] };
+
+				//Scaling against the single threaded run of the same scene, if there is one
+				const auto baseline{ std::find_if(results.begin(), results.end(), [&](const Result& other)
+					{
+						return other.sceneName == result.sceneName && other.threadCount == 1;
+					}) };
+
+				output << (i == 0 ? "\n" : ",\n");
+				output << "    {\n";
+				output << "      \"scene\": \"" << EscapeJson(result.sceneName) << "\",\n";
+				output << "      \"threads\": " << result.threadCount << ",\n";
+				output << "      \"camera\": { \"origin\": [" << result.camera.origin.x << ", " << result.camera.origin.y << ", " << result.camera.origin.z
+					<< "], \"pitch\": " << result.camera.totalPitch << ", \"yaw\": " << result.camera.totalYaw
+					<< ", \"fovAngle\": " << result.camera.fovAngle << " },\n";
+				output << "      \"msPerFrame\": " << result.meanFrameTime << ",\n";
+				output << "      \"minMs\": " << result.frameTimes.front() << ",\n";
+				output << "      \"p50Ms\": " << GetPercentile(result.frameTimes, 50.0) << ",\n";
+				output << "      \"p95Ms\": " << GetPercentile(result.frameTimes, 95.0) << ",\n";
+				output << "      \"p99Ms\": " << GetPercentile(result.frameTimes, 99.0) << ",\n";
+				output << "      \"maxMs\": " << result.frameTimes.back() << ",\n";
+				output << "      \"primaryMraysPerSecond\": " << pixelCount / (result.meanFrameTime * 1000.0);
+
+				if (Statistics::IsEnabled())
+				{
+					const double rayCount{ double(result.statistics.primaryRays + result.statistics.shadowRays) };
+					output << ",\n";
+					output << "      \"totalMraysPerSecond\": " << rayCount / (result.meanFrameTime * 1000.0) << ",\n";
+					output << "      \"statistics\": ";
+					Statistics::WriteJson(output, result.statistics);
+				}
+
+				if (baseline != results.end())
+				{
+					const double speedup{ baseline->meanFrameTime / result.meanFrameTime };
+					output << ",\n";
+					output << "      \"speedup\": " << speedup << ",\n";
+					output << "      \"scalingEfficiency\": " << speedup / result.threadCount;
+				}
+				output << "\n    }";
+			}
+
+			output << "\n  ]\n";
+			output << "}\n";
+		}
+	}
+
+	namespace SceneBenchmark
+	{
+		int Run(const Settings& settings)
+		{
+			const std::vector<uint32_t> threadCounts{ settings.threadCounts.empty() ? GetDefaultThreadCounts() : settings.threadCounts };
+
+			std::vector<Result> results{};
+			for (const std::string& sceneName : settings.sceneNames)
+			{
+				Scene* pScene{ CreateScene(sceneName) };
+				if (!pScene)
+				{
+					std::cout << "Unknown scene " << sceneName << std::endl;
+					return 1;
+				}
+
+				//One update builds the acceleration structures, the camera keeps its start pose for every frame
+				Timer timer{};
+				pScene->Initialize();
+				pScene->Update(&timer);
+
+				for (const uint32_t threadCount : threadCounts)
+				{
+					results.push_back(Measure(pScene, sceneName, threadCount, settings));
+
+					const Result& result{ results.back() };
+					std::cout << sceneName << " @ " << result.threadCount << " thread(s): "
+						<< result.meanFrameTime << " ms/frame, p99 " << GetPercentile(result.frameTimes, 99.0) << " ms" << std::endl;
+				}
+
+				delete pScene;
+			}
+
+			std::ofstream file{ settings.outputPath };
+			if (!file)
+			{
+				std::cout << "Could not write " << settings.outputPath << std::endl;
+				return 1;
+			}
+
+			WriteJson(file, results, settings);
+			std::cout << "Results written to " << settings.outputPath << std::endl;
+			return 0;
+		}
+	}
+}
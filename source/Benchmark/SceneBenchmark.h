@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	namespace SceneBenchmark
+	{
+		struct Settings
+		{
+			std::vector<std::string> sceneNames{ "W1", "W2", "W3", "W4", "Bunny" };
+			uint32_t width{ 640 };
+			uint32_t height{ 480 };
+			uint32_t warmupFrames{ 3 };
+			uint32_t frameCount{ 30 };
+			std::vector<uint32_t> threadCounts{}; //Empty: 1, 2, 4, ... up to the hardware concurrency
+			std::string outputPath{ "BenchmarkResults.json" };
+		};
+
+		/**
+		 * \brief Renders every scene headless with its fixed start camera at every thread count
+		 * and writes frame time statistics, ray throughput and thread scaling as JSON
+		 * \return 0 on success
+		 */
+		int Run(const Settings& settings);
+	}
+}
@@ -0,0 +1,294 @@
+#include "SceneChecks.h"
+
+//Standard includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+//Project includes
+#include "../Renderer.h"
+#include "../Scene.h"
+#include "../Timer.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t ImageWidth{ 160 };
+		constexpr uint32_t ImageHeight{ 120 };
+
+		//Empty scene the checks fill themselves
+		class Scene_Check final : public Scene
+		{
+		public:
+			using Scene::AddMaterial;
+			using Scene::AddPlane;
+			using Scene::AddPointLight;
+			using Scene::AddTriangleMesh;
+			using Scene::AddInstancedMesh;
+			using Scene::AddTriangleMeshInstance;
+
+			void Initialize() override {}
+
+			//Camera in front of the origin, a back wall and a light, returns the material for the meshes
+			unsigned char SetUpStage()
+			{
+				m_Camera = { { 0.f, 0.f, -6.f }, 45.f };
+
+				const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+				AddPlane(Vector3{ 0.f, 0.f, 3.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue);
+				AddPointLight(Vector3{ 0.f, 5.f, -5.f }, 50.f, ColorRGB{ 1.f, 0.8f, .45f });
+
+				return AddMaterial(Material_Lambert(colors::White, 1.f));
+			}
+
+			TriangleMesh& GetSharedMesh(uint32_t meshIndex) { return m_InstancedMeshes[meshIndex]; }
+		};
+
+		//Torus around the z axis facing the camera, ringCount rings of segmentCount vertices around the tube
+		void GenerateTorus(TriangleMesh& mesh, uint32_t ringCount, uint32_t segmentCount, float radius, float tubeRadius)
+		{
+			mesh.positions.clear();
+			mesh.indices.clear();
+
+			for (uint32_t ring{}; ring < ringCount; ++ring)
+			{
+				const float ringAngle{ 2.f * PI * ring / ringCount };
+				for (uint32_t segment{}; segment < segmentCount; ++segment)
+				{
+					const float segmentAngle{ 2.f * PI * segment / segmentCount };
+					const float distance{ radius + tubeRadius * std::cos(segmentAngle) };
+					mesh.positions.emplace_back(distance * std::cos(ringAngle), distance * std::sin(ringAngle), tubeRadius * std::sin(segmentAngle));
+				}
+			}
+
+			for (uint32_t ring{}; ring < ringCount; ++ring)
+			{
+				const uint32_t nextRing{ (ring + 1) % ringCount };
+				for (uint32_t segment{}; segment < segmentCount; ++segment)
+				{
+					const uint32_t nextSegment{ (segment + 1) % segmentCount };
+					const int v0{ int(ring * segmentCount + segment) };
+					const int v1{ int(nextRing * segmentCount + segment) };
+					const int v2{ int(nextRing * segmentCount + nextSegment) };
+					const int v3{ int(ring * segmentCount + nextSegment) };
+
+					mesh.indices.insert(mesh.indices.end(), { v0, v1, v2, v0, v2, v3 });
+				}
+			}
+
+			mesh.normals.clear();
+			mesh.CalculateNormals();
+		}
+
+		void RenderScene(Scene_Check& scene, Renderer& renderer)
+		{
+			Timer timer{};
+			scene.Update(&timer);
+			renderer.Render(&scene);
+		}
+
+		//Pixels where any channel differs by more than tolerance
+		uint32_t CountDifferentPixels(const FrameBuffer& frameBuffer, const FrameBuffer& referenceBuffer, int tolerance)
+		{
+			uint32_t differentCount{};
+			for (uint32_t py{}; py < frameBuffer.GetHeight(); ++py)
+			{
+				const uint32_t* pRow{ frameBuffer.GetPixels() + py * frameBuffer.GetPitch() };
+				const uint32_t* pReferenceRow{ referenceBuffer.GetPixels() + py * referenceBuffer.GetPitch() };
+				for (uint32_t px{}; px < frameBuffer.GetWidth(); ++px)
+				{
+					for (int shift{}; shift < 24; shift += 8)
+					{
+						const int channel{ int((pRow[px] >> shift) & 0xff) };
+						const int referenceChannel{ int((pReferenceRow[px] >> shift) & 0xff) };
+						if (std::abs(channel - referenceChannel) > tolerance)
+						{
+							++differentCount;
+							break;
+						}
+					}
+				}
+			}
+			return differentCount;
+		}
+
+		//Images of the same geometry traced through different trees only differ where hits tie
+		bool AreImagesEquivalent(const FrameBuffer& frameBuffer, const FrameBuffer& referenceBuffer)
+		{
+			const uint32_t pixelCount{ frameBuffer.GetWidth() * frameBuffer.GetHeight() };
+			return CountDifferentPixels(frameBuffer, referenceBuffer, 2) * 1000 <= pixelCount;
+		}
+
+		bool Report(const char* name, bool hasPassed)
+		{
+			std::cout << (hasPassed ? "  passed  " : "  FAILED  ") << name << std::endl;
+			return hasPassed;
+		}
+
+		//A mesh whose vertices change after its first build is rebuilt with the linear builder, which has to
+		//render like the SAH build of the same vertices
+		bool CheckAnimatedMeshRebuild()
+		{
+			constexpr uint32_t ringCount{ 64 };
+			constexpr uint32_t segmentCount{ 32 };
+
+			Scene_Check animatedScene{};
+			TriangleMesh* pAnimatedMesh{ animatedScene.AddTriangleMesh(TriangleCullMode::NoCulling, animatedScene.SetUpStage()) };
+			GenerateTorus(*pAnimatedMesh, ringCount, segmentCount, 1.5f, 0.5f);
+			pAnimatedMesh->UpdateTransforms();
+
+			//Every vertex takes the place of another one spread across the torus (the stride is odd and the vertex count a power
+			//of two, so each is taken once): the triangles become slivers through it, which no refit can follow
+			const std::vector<Vector3> positions{ pAnimatedMesh->positions };
+			for (size_t i{}; i < positions.size(); ++i)
+			{
+				pAnimatedMesh->positions[i] = positions[(i * 7919) % positions.size()];
+			}
+			pAnimatedMesh->normals.clear();
+			pAnimatedMesh->CalculateNormals();
+			pAnimatedMesh->UpdateTransforms();
+
+			const bool isRebuiltLinear{ pAnimatedMesh->bvhBuilder == BVHBuilder::Linear && pAnimatedMesh->bvh.GetBuildStatistics().refitCount == 0 };
+
+			Scene_Check referenceScene{};
+			TriangleMesh* pReferenceMesh{ referenceScene.AddTriangleMesh(TriangleCullMode::NoCulling, referenceScene.SetUpStage()) };
+			pReferenceMesh->positions = pAnimatedMesh->positions;
+			pReferenceMesh->indices = pAnimatedMesh->indices;
+			pReferenceMesh->normals = pAnimatedMesh->normals;
+			pReferenceMesh->UpdateTransforms();
+
+			Renderer renderer{ ImageWidth, ImageHeight };
+			Renderer referenceRenderer{ ImageWidth, ImageHeight };
+			RenderScene(animatedScene, renderer);
+			RenderScene(referenceScene, referenceRenderer);
+
+			return Report("animated mesh rebuilt with the linear builder", isRebuiltLinear && pReferenceMesh->bvhBuilder == BVHBuilder::SAH)
+				& Report("linear rebuild renders like the SAH build", AreImagesEquivalent(renderer.GetFrameBuffer(), referenceRenderer.GetFrameBuffer()));
+		}
+
+		//Front of the tube of the torus at ringPoint (on its ring), seen along +z
+		bool IsTorusHitAt(const Scene& scene, const Vector3& ringPoint, float tubeRadius)
+		{
+			const Ray ray{ ringPoint - Vector3{ 0.f, 0.f, 10.f }, Vector3::UnitZ };
+
+			HitRecord hit{};
+			scene.GetClosestHit(ray, hit);
+			return hit.didHit && std::abs(hit.origin.z - (ringPoint.z - tubeRadius)) < 1e-3f && scene.DoesHit(ray);
+		}
+
+		//A mesh moved after the top level build is hit where it went, and no longer where it was, both when only its transform
+		//changed (placed in O(1)) and when its vertices were transformed again
+		bool CheckMovedMesh()
+		{
+			constexpr float radius{ 0.5f };
+			constexpr float tubeRadius{ 0.2f };
+			const Vector3 startPoint{ radius, 0.f, 0.f };
+			const Vector3 rigidTranslation{ 1.5f, 1.f, 0.5f };
+			const Vector3 vertexTranslation{ -1.5f, -0.5f, 0.f };
+
+			Scene_Check scene{};
+			TriangleMesh* pMesh{ scene.AddTriangleMesh(TriangleCullMode::BackFaceCulling, scene.SetUpStage()) };
+			GenerateTorus(*pMesh, 32, 16, radius, tubeRadius);
+			pMesh->UpdateTransforms();
+
+			Renderer renderer{ ImageWidth, ImageHeight };
+			RenderScene(scene, renderer);
+			const bool isHitAtStart{ IsTorusHitAt(scene, startPoint, tubeRadius) };
+
+			pMesh->Translate(rigidTranslation);
+			pMesh->UpdateRigidTransform();
+			RenderScene(scene, renderer);
+			const bool isRigidMoveHit{ pMesh->isPlaced && IsTorusHitAt(scene, startPoint + rigidTranslation, tubeRadius) && !IsTorusHitAt(scene, startPoint, tubeRadius) };
+
+			//The same torus built where the placed one went
+			Scene_Check referenceScene{};
+			TriangleMesh* pReferenceMesh{ referenceScene.AddTriangleMesh(TriangleCullMode::BackFaceCulling, referenceScene.SetUpStage()) };
+			GenerateTorus(*pReferenceMesh, 32, 16, radius, tubeRadius);
+			pReferenceMesh->Translate(rigidTranslation);
+			pReferenceMesh->UpdateTransforms();
+
+			Renderer referenceRenderer{ ImageWidth, ImageHeight };
+			RenderScene(referenceScene, referenceRenderer);
+			const bool isRigidMoveEquivalent{ AreImagesEquivalent(renderer.GetFrameBuffer(), referenceRenderer.GetFrameBuffer()) };
+
+			pMesh->Translate(vertexTranslation);
+			pMesh->UpdateTransforms();
+			RenderScene(scene, renderer);
+			const bool isVertexMoveHit{ !pMesh->isPlaced && IsTorusHitAt(scene, startPoint + vertexTranslation, tubeRadius)
+				&& !IsTorusHitAt(scene, startPoint + rigidTranslation, tubeRadius) };
+
+			return Report("mesh hit before it moves", isHitAtStart)
+				& Report("mesh moved with UpdateRigidTransform is hit at its new position", isRigidMoveHit)
+				& Report("mesh moved with UpdateRigidTransform renders like one built there", isRigidMoveEquivalent)
+				& Report("mesh moved with UpdateTransforms is hit at its new position", isVertexMoveHit);
+		}
+
+		//A mirroring instance culls the faces the mesh with its vertices transformed the same way culls, for primary rays
+		//(packets), shadow rays and cached occluders alike
+		bool CheckMirroredInstance()
+		{
+			const Matrix mirror{ Matrix::CreateScale(-1.f, 1.f, 1.f) * Matrix::CreateRotationY(0.6f) * Matrix::CreateTranslation(0.5f, 0.5f, 0.f) };
+
+			Scene_Check instanceScene{};
+			const unsigned char material{ instanceScene.SetUpStage() };
+			const uint32_t meshIndex{ instanceScene.AddInstancedMesh(TriangleCullMode::BackFaceCulling) };
+			TriangleMesh& sharedMesh{ instanceScene.GetSharedMesh(meshIndex) };
+			GenerateTorus(sharedMesh, 48, 24, 1.f, 0.4f);
+			sharedMesh.UpdateTransforms();
+			const TriangleMeshInstance* pInstance{ instanceScene.AddTriangleMeshInstance(meshIndex, mirror, material) };
+			const bool isMirrored{ pInstance->isMirrored };
+
+			Scene_Check referenceScene{};
+			TriangleMesh* pReferenceMesh{ referenceScene.AddTriangleMesh(TriangleCullMode::BackFaceCulling, referenceScene.SetUpStage()) };
+			GenerateTorus(*pReferenceMesh, 48, 24, 1.f, 0.4f);
+			pReferenceMesh->Scale({ -1.f, 1.f, 1.f });
+			pReferenceMesh->RotateY(0.6f);
+			pReferenceMesh->Translate({ 0.5f, 0.5f, 0.f });
+			pReferenceMesh->UpdateTransforms();
+
+			Renderer renderer{ ImageWidth, ImageHeight };
+			Renderer referenceRenderer{ ImageWidth, ImageHeight };
+			RenderScene(instanceScene, renderer);
+			RenderScene(referenceScene, referenceRenderer);
+
+			//Single rays over the torus, the renders above trace packets. Rays grazing its silhouette may hit or miss
+			//either way, like pixels of the renders
+			constexpr int gridSize{ 16 };
+			int mismatchCount{};
+			for (int i{}; i < gridSize * gridSize; ++i)
+			{
+				const Vector3 origin{ -2.f + (i % gridSize + 0.37f) * 4.f / gridSize, -1.5f + (i / gridSize + 0.61f) * 4.f / gridSize, -6.f };
+				const Ray ray{ origin, Vector3::UnitZ };
+
+				HitRecord hit{};
+				HitRecord referenceHit{};
+				instanceScene.GetClosestHit(ray, hit);
+				referenceScene.GetClosestHit(ray, referenceHit);
+				if (hit.didHit != referenceHit.didHit || std::abs(hit.t - referenceHit.t) > 1e-3f || instanceScene.DoesHit(ray) != referenceScene.DoesHit(ray))
+					++mismatchCount;
+			}
+			const bool isSingleRayEquivalent{ mismatchCount * 32 <= gridSize * gridSize };
+
+			return Report("mirroring instance transform detected", isMirrored)
+				& Report("mirrored instance is hit like the mirrored mesh", isSingleRayEquivalent)
+				& Report("mirrored instance renders like the mirrored mesh", AreImagesEquivalent(renderer.GetFrameBuffer(), referenceRenderer.GetFrameBuffer()));
+		}
+	}
+
+	namespace SceneChecks
+	{
+		int Run()
+		{
+			std::cout << "Scene checks" << std::endl;
+
+			bool hasPassed{ true };
+			hasPassed &= CheckAnimatedMeshRebuild();
+			hasPassed &= CheckMovedMesh();
+			hasPassed &= CheckMirroredInstance();
+
+			std::cout << (hasPassed ? "All checks passed" : "Some checks FAILED") << std::endl;
+			return hasPassed ? 0 : 1;
+		}
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace dae
+{
+	namespace SceneChecks
+	{
+		/**
+		 * \brief Traces and renders small generated scenes to check that the fast paths (e.g. linear BVH rebuilds
+		 * of animated meshes) give the same result as the reference ones, and prints the outcome of every check
+		 * \return 0 when every check passed
+		 */
+		int Run();
+	}
+}
@@ -0,0 +1,209 @@
+//Standard includes
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Project includes
+#include "BVHBenchmark.h"
+#include "MathBenchmark.h"
+#include "SceneBenchmark.h"
+#include "SceneChecks.h"
+
+using namespace dae;
+
+void PrintUsage()
+{
+	std::cout << "Usage: Benchmark <suite> [options]" << std::endl;
+	std::cout << "  math [iterations]          inline vs out-of-line vector/matrix math" << std::endl;
+	std::cout << "  scenes [options]           headless scene renders, results as JSON" << std::endl;
+	std::cout << "    --scenes <a,b,...>       scenes to render (default W1,W2,W3,W4,Bunny)" << std::endl;
+	std::cout << "    --resolution <WxH>       image size (default 640x480)" << std::endl;
+	std::cout << "    --frames <n>             measured frames per run (default 30)" << std::endl;
+	std::cout << "    --warmup <n>             unmeasured frames per run (default 3)" << std::endl;
+	std::cout << "    --threads <a,b,...>      thread counts (default 1, 2, 4, ... all cores)" << std::endl;
+	std::cout << "    --output <path>          JSON file (default BenchmarkResults.json)" << std::endl;
+	std::cout << "  bvh [options]              BVH builds and traces of generated meshes, results as JSON" << std::endl;
+	std::cout << "    --triangles <a,b,...>    mesh sizes (default 65536,262144,1048576)" << std::endl;
+	std::cout << "    --threads <a,b,...>      thread counts (default 1, 2, 4, ... all cores)" << std::endl;
+	std::cout << "    --iterations <n>         builds per mesh, builder and thread count (default 5)" << std::endl;
+	std::cout << "    --rays <n>               rays traced through every tree (default 262144)" << std::endl;
+	std::cout << "    --output <path>          JSON file (default BVHBenchmarkResults.json)" << std::endl;
+	std::cout << "  checks                     fast paths against their reference, nonzero exit code on a failure" << std::endl;
+}
+
+bool ParseUInt(std::string_view text, uint32_t& value)
+{
+	const auto [pEnd, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	return error == std::errc{} && pEnd == text.data() + text.size();
+}
+
+std::vector<std::string_view> Split(std::string_view text, char separator)
+{
+	std::vector<std::string_view> parts{};
+	size_t start{};
+	while (start <= text.size())
+	{
+		const size_t end{ std::min(text.find(separator, start), text.size()) };
+		parts.push_back(text.substr(start, end - start));
+		start = end + 1;
+	}
+	return parts;
+}
+
+bool ParseSceneSettings(int argc, char* args[], SceneBenchmark::Settings& settings)
+{
+	for (int i{ 2 }; i + 1 < argc; i += 2)
+	{
+		const std::string_view argument{ args[i] };
+		const std::string_view value{ args[i + 1] };
+
+		if (argument == "--scenes")
+		{
+			settings.sceneNames.clear();
+			for (const std::string_view name : Split(value, ','))
+			{
+				settings.sceneNames.emplace_back(name);
+			}
+		}
+		else if (argument == "--resolution")
+		{
+			const std::vector<std::string_view> size{ Split(value, 'x') };
+			if (size.size() != 2 || !ParseUInt(size[0], settings.width) || !ParseUInt(size[1], settings.height))
+				return false;
+		}
+		else if (argument == "--frames")
+		{
+			if (!ParseUInt(value, settings.frameCount))
+				return false;
+		}
+		else if (argument == "--warmup")
+		{
+			if (!ParseUInt(value, settings.warmupFrames))
+				return false;
+		}
+		else if (argument == "--threads")
+		{
+			settings.threadCounts.clear();
+			for (const std::string_view count : Split(value, ','))
+			{
+				uint32_t threadCount{};
+				if (!ParseUInt(count, threadCount) || threadCount == 0)
+					return false;
+				settings.threadCounts.push_back(threadCount);
+			}
+		}
+		else if (argument == "--output")
+		{
+			settings.outputPath = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	//Options come in pairs
+	return argc % 2 == 0 && settings.width > 0 && settings.height > 0 && settings.frameCount > 0;
+}
+
+bool ParseUIntList(std::string_view text, std::vector<uint32_t>& values)
+{
+	values.clear();
+	for (const std::string_view part : Split(text, ','))
+	{
+		uint32_t value{};
+		if (!ParseUInt(part, value) || value == 0)
+			return false;
+		values.push_back(value);
+	}
+	return true;
+}
+
+bool ParseBVHSettings(int argc, char* args[], BVHBenchmark::Settings& settings)
+{
+	for (int i{ 2 }; i + 1 < argc; i += 2)
+	{
+		const std::string_view argument{ args[i] };
+		const std::string_view value{ args[i + 1] };
+
+		if (argument == "--triangles")
+		{
+			if (!ParseUIntList(value, settings.triangleCounts))
+				return false;
+		}
+		else if (argument == "--threads")
+		{
+			if (!ParseUIntList(value, settings.threadCounts))
+				return false;
+		}
+		else if (argument == "--iterations")
+		{
+			if (!ParseUInt(value, settings.iterations))
+				return false;
+		}
+		else if (argument == "--rays")
+		{
+			if (!ParseUInt(value, settings.rayCount))
+				return false;
+		}
+		else if (argument == "--output")
+		{
+			settings.outputPath = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	//Options come in pairs
+	return argc % 2 == 0 && settings.iterations > 0 && settings.rayCount > 0;
+}
+
+int main(int argc, char* args[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (std::strcmp(args[1], "math") == 0)
+	{
+		const uint32_t iterations{ argc > 2 ? static_cast<uint32_t>(std::strtoul(args[2], nullptr, 10)) : 1u << 22 };
+		return MathBenchmark::Run(iterations > 0 ? iterations : 1u << 22);
+	}
+
+	if (std::strcmp(args[1], "scenes") == 0)
+	{
+		SceneBenchmark::Settings settings{};
+		if (!ParseSceneSettings(argc, args, settings))
+		{
+			PrintUsage();
+			return 1;
+		}
+		return SceneBenchmark::Run(settings);
+	}
+
+	if (std::strcmp(args[1], "bvh") == 0)
+	{
+		BVHBenchmark::Settings settings{};
+		if (!ParseBVHSettings(argc, args, settings))
+		{
+			PrintUsage();
+			return 1;
+		}
+		return BVHBenchmark::Run(settings);
+	}
+
+	if (std::strcmp(args[1], "checks") == 0)
+		return SceneChecks::Run();
+
+	PrintUsage();
+	return 1;
+}
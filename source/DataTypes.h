@@ -1,11 +1,20 @@
 #pragma once
 #include <cassert>
+#include <cfloat>
+#include <cstring>
 
 #include "Math.h"
+#include "BVH.h"
 #include "vector"
 
 namespace dae
 {
+	//Lanes of the widest intersection kernel (AVX2). BVH leaves are sized in batches of it and
+	//the SoA stores are padded so a full width load from the start of any range stays in bounds
+	constexpr uint32_t MaxSimdWidth{ 8 };
+
+	struct Ray;
+
 #pragma region GEOMETRY
 	struct Sphere
 	{
@@ -15,6 +24,54 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 
+	//Spheres in Structure of Arrays layout for the batched intersection kernels
+	struct SphereSoA
+	{
+		static constexpr uint32_t PaddingCount{ MaxSimdWidth - 1 };
+
+		std::vector<float> originX{}, originY{}, originZ{};
+		std::vector<float> radius{};
+		std::vector<unsigned char> materialIndex{};
+
+		void Clear()
+		{
+			for (std::vector<float>* pComponent : { &originX, &originY, &originZ, &radius })
+			{
+				pComponent->clear();
+			}
+			materialIndex.clear();
+		}
+
+		void Reserve(size_t count)
+		{
+			for (std::vector<float>* pComponent : { &originX, &originY, &originZ, &radius })
+			{
+				pComponent->reserve(count);
+			}
+			materialIndex.reserve(count);
+		}
+
+		void Add(const Sphere& sphere)
+		{
+			originX.push_back(sphere.origin.x);
+			originY.push_back(sphere.origin.y);
+			originZ.push_back(sphere.origin.z);
+			radius.push_back(sphere.radius);
+			materialIndex.push_back(sphere.materialIndex);
+		}
+
+		//Zero radius spheres, only ever read by masked out lanes
+		void AddPadding()
+		{
+			for (std::vector<float>* pComponent : { &originX, &originY, &originZ, &radius })
+			{
+				pComponent->insert(pComponent->end(), PaddingCount, 0.f);
+			}
+		}
+
+		Vector3 GetOrigin(uint32_t index) const { return { originX[index], originY[index], originZ[index] }; }
+	};
+
 	struct Plane
 	{
 		Vector3 origin{};
@@ -54,6 +111,117 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Intersection-ready triangles: v0 and both edges in Structure of Arrays layout, stored in BVH primitive order
+	//so every BVH leaf is one contiguous range. Normals are only read once a hit is found.
+	struct TriangleSoA
+	{
+		static constexpr uint32_t PaddingCount{ MaxSimdWidth - 1 };
+
+		std::vector<float> v0X{}, v0Y{}, v0Z{};
+		std::vector<float> edge1X{}, edge1Y{}, edge1Z{};
+		std::vector<float> edge2X{}, edge2Y{}, edge2Z{};
+		std::vector<Vector3> normals{};
+
+		void Clear()
+		{
+			for (std::vector<float>* pComponent : { &v0X, &v0Y, &v0Z, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z })
+			{
+				pComponent->clear();
+			}
+			normals.clear();
+		}
+
+		void Reserve(size_t count)
+		{
+			for (std::vector<float>* pComponent : { &v0X, &v0Y, &v0Z, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z })
+			{
+				pComponent->reserve(count);
+			}
+			normals.reserve(count);
+		}
+
+		void Add(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Vector3& normal)
+		{
+			const Vector3 edge1{ v1 - v0 };
+			const Vector3 edge2{ v2 - v0 };
+
+			v0X.push_back(v0.x);
+			v0Y.push_back(v0.y);
+			v0Z.push_back(v0.z);
+			edge1X.push_back(edge1.x);
+			edge1Y.push_back(edge1.y);
+			edge1Z.push_back(edge1.z);
+			edge2X.push_back(edge2.x);
+			edge2Y.push_back(edge2.y);
+			edge2Z.push_back(edge2.z);
+			normals.push_back(normal);
+		}
+
+		//Degenerate (all zero) triangles, never hit and never part of a BVH leaf
+		void AddPadding()
+		{
+			for (std::vector<float>* pComponent : { &v0X, &v0Y, &v0Z, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z })
+			{
+				pComponent->insert(pComponent->end(), PaddingCount, 0.f);
+			}
+		}
+	};
+
+	//One placement of a shared TriangleMesh, which keeps its triangles and BVH in object space (its own transform
+	//included). Rays are moved into object space to trace the mesh, so an instance only costs its transforms, and
+	//moving it leaves the mesh alone. Culling is decided in object space, so a mirroring transform (which reverses the
+	//winding in world space) traces the mesh with GetCullMode, culling the same faces as the mesh transformed by it.
+	struct TriangleMeshInstance
+	{
+		uint32_t meshIndex{}; //Into the instanced meshes of the scene
+		unsigned char materialIndex{};
+
+		Matrix transform{}; //Object to world
+		Matrix inverseTransform{}; //World to object
+		bool isMirrored{ false }; //Negative determinant
+
+		void SetTransform(const Matrix& objectToWorld)
+		{
+			transform = objectToWorld;
+			inverseTransform = Matrix::InverseAffine(objectToWorld);
+			isMirrored = Vector3::Dot(Vector3::Cross(objectToWorld.GetAxisX(), objectToWorld.GetAxisY()), objectToWorld.GetAxisZ()) < 0.f;
+		}
+
+		//Cull mode to trace the mesh with: front and back face culling swap for a mirroring transform
+		TriangleCullMode GetCullMode(TriangleCullMode meshCullMode) const
+		{
+			if (!isMirrored || meshCullMode == TriangleCullMode::NoCulling)
+				return meshCullMode;
+			return meshCullMode == TriangleCullMode::BackFaceCulling ? TriangleCullMode::FrontFaceCulling : TriangleCullMode::BackFaceCulling;
+		}
+
+		//Direction is not normalized, so distances along the ray stay the same in both spaces
+		Ray ToObjectSpace(const Ray& ray) const;
+
+		//Normals go through the inverse transpose, which keeps them perpendicular under non-uniform scale
+		Vector3 TransformNormal(const Vector3& normal) const
+		{
+			return Vector3{
+				Vector3::Dot(normal, inverseTransform.GetAxisX()),
+				Vector3::Dot(normal, inverseTransform.GetAxisY()),
+				Vector3::Dot(normal, inverseTransform.GetAxisZ()) }.Normalized();
+		}
+
+		//World space box around the transformed object space bounds
+		AABB TransformBounds(const AABB& objectBounds) const
+		{
+			AABB bounds{};
+			for (int corner{}; corner < 8; ++corner)
+			{
+				bounds.Grow(transform.TransformPoint(
+					corner & 1 ? objectBounds.max.x : objectBounds.min.x,
+					corner & 2 ? objectBounds.max.y : objectBounds.min.y,
+					corner & 4 ? objectBounds.max.z : objectBounds.min.z));
+			}
+			return bounds;
+		}
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -87,6 +255,17 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		//Built over transformedPositions, one primitive per index triple
+		BVH bvh{};
+		BVHBuilder bvhBuilder{ BVHBuilder::SAH }; //UpdateTransforms switches meshes updated after their first build to Linear
+		TriangleSoA triangles{};
+
+		//Final transform transformedPositions, bvh and triangles are in. UpdateRigidTransform leaves them there and
+		//moves the mesh with placement (built to current transform, meshIndex unused) while isPlaced
+		Matrix builtTransform{};
+		TriangleMeshInstance placement{};
+		bool isPlaced{ false };
+
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
@@ -140,13 +319,58 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		//Transforms every vertex and refits or rebuilds the BVH, for changed vertices (a mesh that only moves is cheaper
+		//with UpdateRigidTransform). pThreadPool: threads to build the BVH with, nullptr builds it on the calling thread
+		void UpdateTransforms(ThreadPool* pThreadPool = nullptr)
+		{
+			//The same triangles again after the first build: the mesh is animated (e.g. deforming every frame),
+			//the rebuilds the refits cannot avoid use the linear builder from now on
+			if (!bvh.IsEmpty() && bvh.GetPrimitiveCount() == indices.size() / 3)
+				bvhBuilder = BVHBuilder::Linear;
+
+			TransformVertices();
+
+			//Update Acceleration Structure (transformedPositions > bvh > triangles), refit while the
+			//triangles are the ones it was built for and the tree did not get too bad
+			if (!RefitBVH())
+				BuildBVH(pThreadPool);
+			BuildTriangles();
+		}
+
+		/**
+		 * \brief Moves the built mesh to its current transform (Translate, RotateY, Scale) in O(1) instead of transforming
+		 * every vertex: rays go through placement into the space it was built in, like for an instance. For meshes that
+		 * only move (e.g. every frame of an animation), changed vertices need UpdateTransforms. Not for instanced meshes.
+		 * \param pThreadPool threads to build the BVH with when there is none yet, nullptr builds it on the calling thread
+		 */
+		void UpdateRigidTransform(ThreadPool* pThreadPool = nullptr)
+		{
+			if (bvh.IsEmpty())
+			{
+				UpdateTransforms(pThreadPool);
+				return;
+			}
+
+			const Matrix finalTransform{ GetFinalTransform() };
+			placement.SetTransform(Matrix::InverseAffine(builtTransform) * finalTransform);
+			placement.materialIndex = materialIndex;
+			isPlaced = std::memcmp(&finalTransform, &builtTransform, sizeof(Matrix)) != 0;
+		}
+
+		Matrix GetFinalTransform() const
+		{
+			return scaleTransform * rotationTransform * translationTransform;
+		}
+
+		void TransformVertices()
 		{
 			/*transformedPositions = positions;
 			transformedNormals = normals;*/
 		
 			//Calculate Final Transform 
-			const Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
+			const Matrix finalTransform = GetFinalTransform();
+			builtTransform = finalTransform;
+			isPlaced = false;
 			
 
 			//Transform Positions (positions > transformedPositions)
@@ -171,7 +395,56 @@ namespace dae
 				transformedNormals[i] = finalTransform.TransformVector(normals[i]);
 			}*/
 		}
+
+		std::vector<AABB> GetTriangleBounds() const
+		{
+			std::vector<AABB> triangleBounds{};
+			triangleBounds.reserve(indices.size() / 3);
+			for (uint64_t i{}; i + 2 < indices.size(); i += 3)
+			{
+				AABB& bounds{ triangleBounds.emplace_back() };
+				bounds.Grow(transformedPositions[indices[i]]);
+				bounds.Grow(transformedPositions[indices[i + 1]]);
+				bounds.Grow(transformedPositions[indices[i + 2]]);
+			}
+			return triangleBounds;
+		}
+
+		void BuildBVH(ThreadPool* pThreadPool = nullptr)
+		{
+			bvh.Build(bvhBuilder, GetTriangleBounds(), MaxSimdWidth, pThreadPool);
+		}
+
+		//Fits the BVH to the transformed positions, false when it has to be built instead: there is none yet,
+		//triangles were added, or the refit tree degraded past BVH::MaxDegradation
+		bool RefitBVH()
+		{
+			if (bvh.IsEmpty() || bvh.GetPrimitiveCount() != indices.size() / 3 || bvh.GetBatchSize() != MaxSimdWidth)
+				return false;
+
+			bvh.Refit(GetTriangleBounds());
+			return !bvh.NeedsRebuild();
+		}
+
+		void BuildTriangles()
+		{
+			const std::vector<uint32_t>& triangleIndices{ bvh.GetPrimitiveIndices() };
+
+			triangles.Clear();
+			triangles.Reserve(triangleIndices.size() + TriangleSoA::PaddingCount);
+			for (const uint32_t triangleIndex : triangleIndices)
+			{
+				const uint64_t firstIndex{ triangleIndex * 3ull };
+				triangles.Add(
+					transformedPositions[indices[firstIndex]],
+					transformedPositions[indices[firstIndex + 1]],
+					transformedPositions[indices[firstIndex + 2]],
+					transformedNormals[triangleIndex].Normalized());
+			}
+			triangles.AddPadding();
+		}
 	};
+
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
@@ -210,4 +483,9 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 #pragma endregion
+
+	inline Ray TriangleMeshInstance::ToObjectSpace(const Ray& ray) const
+	{
+		return { inverseTransform.TransformPoint(ray.origin), inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
+	}
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "FrameBuffer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <new>
+
+namespace dae
+{
+	namespace
+	{
+		template<typename T>
+		void WriteLittleEndian(std::ofstream& file, T value)
+		{
+			for (size_t i{}; i < sizeof(T); ++i)
+			{
+				file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+			}
+		}
+	}
+
+	FrameBuffer::FrameBuffer(uint32_t width, uint32_t height)
+	{
+		Resize(width, height);
+	}
+
+	FrameBuffer::~FrameBuffer()
+	{
+		Release();
+	}
+
+	void FrameBuffer::Resize(uint32_t width, uint32_t height)
+	{
+		Release();
+
+		//Round rows up to whole cache lines so threads writing different rows never share a line
+		constexpr uint32_t pixelsPerLine{ Alignment / sizeof(uint32_t) };
+		m_Width = width;
+		m_Height = height;
+		m_Pitch = (width + pixelsPerLine - 1) / pixelsPerLine * pixelsPerLine;
+
+		const size_t pixelCount{ size_t(m_Pitch) * m_Height };
+		if (pixelCount == 0)
+			return;
+
+		m_pPixels = static_cast<uint32_t*>(::operator new(pixelCount * sizeof(uint32_t), std::align_val_t{ Alignment }));
+		std::fill(m_pPixels, m_pPixels + pixelCount, PackColor(0, 0, 0));
+	}
+
+	bool FrameBuffer::SaveToBMP(const std::string& path) const
+	{
+		std::ofstream file{ path, std::ios::binary };
+		if (!file)
+			return false;
+
+		constexpr uint32_t fileHeaderSize{ 14 };
+		constexpr uint32_t infoHeaderSize{ 40 };
+		const uint32_t imageSize{ m_Width * m_Height * 4 };
+
+		//BITMAPFILEHEADER
+		file.put('B');
+		file.put('M');
+		WriteLittleEndian<uint32_t>(file, fileHeaderSize + infoHeaderSize + imageSize);
+		WriteLittleEndian<uint32_t>(file, 0);
+		WriteLittleEndian<uint32_t>(file, fileHeaderSize + infoHeaderSize);
+
+		//BITMAPINFOHEADER, negative height stores the rows top-down like the buffer
+		WriteLittleEndian<uint32_t>(file, infoHeaderSize);
+		WriteLittleEndian<int32_t>(file, static_cast<int32_t>(m_Width));
+		WriteLittleEndian<int32_t>(file, -static_cast<int32_t>(m_Height));
+		WriteLittleEndian<uint16_t>(file, 1); //Planes
+		WriteLittleEndian<uint16_t>(file, 32); //Bits per pixel
+		WriteLittleEndian<uint32_t>(file, 0); //BI_RGB
+		WriteLittleEndian<uint32_t>(file, imageSize);
+		WriteLittleEndian<int32_t>(file, 2835); //72 DPI
+		WriteLittleEndian<int32_t>(file, 2835);
+		WriteLittleEndian<uint32_t>(file, 0);
+		WriteLittleEndian<uint32_t>(file, 0);
+
+		//0xAARRGGBB in (little endian) memory already is the B, G, R, A byte order BMP expects
+		for (uint32_t y{}; y < m_Height; ++y)
+		{
+			file.write(reinterpret_cast<const char*>(m_pPixels + size_t(y) * m_Pitch), std::streamsize(m_Width) * 4);
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	void FrameBuffer::Release()
+	{
+		if (m_pPixels)
+			::operator delete(m_pPixels, std::align_val_t{ Alignment });
+
+		m_pPixels = nullptr;
+		m_Width = 0;
+		m_Height = 0;
+		m_Pitch = 0;
+	}
+}
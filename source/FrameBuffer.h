@@ -0,0 +1,56 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	//Image the renderer draws into, independent of any window.
+	//Pixels are 0xAARRGGBB (SDL_PIXELFORMAT_ARGB8888) and every row starts on its own cache line.
+	class FrameBuffer final
+	{
+	public:
+		static constexpr uint32_t Alignment{ 64 };
+
+		FrameBuffer() = default;
+		FrameBuffer(uint32_t width, uint32_t height);
+		~FrameBuffer();
+
+		FrameBuffer(const FrameBuffer&) = delete;
+		FrameBuffer(FrameBuffer&&) noexcept = delete;
+		FrameBuffer& operator=(const FrameBuffer&) = delete;
+		FrameBuffer& operator=(FrameBuffer&&) noexcept = delete;
+
+		//Reallocates the pixels, previous contents are lost
+		void Resize(uint32_t width, uint32_t height);
+
+		/**
+		 * \brief Writes the buffer as an uncompressed 32 bit BMP
+		 * \param path file to write
+		 * \return true on success
+		 */
+		bool SaveToBMP(const std::string& path) const;
+
+		uint32_t* GetPixels() { return m_pPixels; }
+		const uint32_t* GetPixels() const { return m_pPixels; }
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetPitch() const { return m_Pitch; } //Pixels per row, including padding
+
+		static constexpr uint32_t PackColor(uint8_t r, uint8_t g, uint8_t b)
+		{
+			return 0xff000000u | (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
+		}
+
+	private:
+		uint32_t* m_pPixels{};
+
+		uint32_t m_Width{};
+		uint32_t m_Height{};
+		uint32_t m_Pitch{};
+
+		void Release();
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+//Standard includes
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace dae
+{
+	//Read only view of a whole file mapped into memory, the pages are loaded by the OS on first access
+	//so large files are neither copied into a buffer nor read through a stream.
+	class MappedFile final
+	{
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		/**
+		 * \brief Maps the file, unmapping the previous one
+		 * \param path file to map
+		 * \return true on success, an empty file counts as success with no data
+		 */
+		bool Open(const std::string& path);
+		void Close();
+
+		bool IsOpen() const { return m_IsOpen; }
+		const char* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+		std::string_view GetView() const { return { m_pData, m_Size }; }
+
+	private:
+		const char* m_pData{};
+		size_t m_Size{};
+		bool m_IsOpen{ false };
+
+#if defined(_WIN32)
+		void* m_FileHandle{};
+		void* m_MappingHandle{};
+#endif
+	};
+}
@@ -1,37 +1,19 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
 
 namespace dae
 {
-#pragma region Material BASE
-	class Material
-	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
-	};
-#pragma endregion
-
 #pragma region Material SOLID COLOR
 	//SOLID COLOR
 	//===========
-	class Material_SolidColor final : public Material
+	class Material_SolidColor final
 	{
 	public:
 		Material_SolidColor(const ColorRGB& color): m_Color(color)
@@ -39,7 +21,7 @@ namespace dae
 
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
 		{
 			return m_Color;
 		}
@@ -52,13 +34,13 @@ namespace dae
 #pragma region Material LAMBERT
 	//LAMBERT
 	//=======
-	class Material_Lambert final : public Material
+	class Material_Lambert final
 	{
 	public:
 		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
 			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
 
 			//todo: W3
@@ -75,7 +57,7 @@ namespace dae
 #pragma region Material LAMBERT PHONG
 	//LAMBERT-PHONG
 	//=============
-	class Material_LambertPhong final : public Material
+	class Material_LambertPhong final
 	{
 	public:
 		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
@@ -84,7 +66,7 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
 			//todo: W3
 			
@@ -102,7 +84,7 @@ namespace dae
 
 #pragma region Material COOK TORRENCE
 	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
+	class Material_CookTorrence final
 	{
 	public:
 		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
@@ -110,7 +92,7 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
 			//todo: W3
 			Vector3 halfVector{(l + v).Normalized()};
@@ -142,4 +124,108 @@ namespace dae
 		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
 	};
 #pragma endregion
+
+#pragma region Material TABLE
+	//A material by value, the index of the alternative is its type tag
+	using Material = std::variant<Material_SolidColor, Material_Lambert, Material_LambertPhong, Material_CookTorrence>;
+
+	//All materials of a scene in one contiguous array, indexed by HitRecord::materialIndex.
+	//Shading switches on the type tag and calls the concrete Shade directly, so it can be inlined.
+	class MaterialTable final
+	{
+	public:
+		static constexpr size_t TypeCount{ std::variant_size_v<Material> };
+		static_assert(TypeCount == 4, "Add the new material type to both Shade functions");
+
+		//Returns the index hit records refer to the material with
+		unsigned char Add(const Material& material)
+		{
+			m_Materials.push_back(material);
+			return static_cast<unsigned char>(m_Materials.size() - 1);
+		}
+
+		size_t GetSize() const { return m_Materials.size(); }
+		const Material& operator[](size_t index) const { return m_Materials[index]; }
+
+		/**
+		 * \brief Shades one hit with the material it refers to
+		 * \param hitRecord hit, materialIndex selects the material
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
+		{
+			const Material& material{ m_Materials[hitRecord.materialIndex] };
+			switch (material.index())
+			{
+			case 0: return std::get_if<0>(&material)->Shade(hitRecord, l, v);
+			case 1: return std::get_if<1>(&material)->Shade(hitRecord, l, v);
+			case 2: return std::get_if<2>(&material)->Shade(hitRecord, l, v);
+			default: return std::get_if<3>(&material)->Shade(hitRecord, l, v);
+			}
+		}
+
+		/**
+		 * \brief Shades many hits at once. The hits are grouped by material type first, so every group
+		 * runs the Shade of one type in a loop without a branch on the type.
+		 * \param pHitRecords hits, materialIndex selects the material
+		 * \param pLightDirections light direction per hit
+		 * \param pViewDirections view direction per hit
+		 * \param count number of hits
+		 * \param pColors receives the color per hit, in the order of the hits
+		 */
+		void Shade(const HitRecord* pHitRecords, const Vector3* pLightDirections, const Vector3* pViewDirections, uint32_t count, ColorRGB* pColors) const
+		{
+			//Counting sort of the hit indices by type tag
+			thread_local std::vector<uint32_t> order{};
+			order.resize(count);
+
+			uint32_t groupStarts[TypeCount + 1]{};
+			for (uint32_t i{}; i < count; ++i)
+			{
+				++groupStarts[m_Materials[pHitRecords[i].materialIndex].index() + 1];
+			}
+			for (size_t type{}; type < TypeCount; ++type)
+			{
+				groupStarts[type + 1] += groupStarts[type];
+			}
+
+			uint32_t groupEnds[TypeCount]{};
+			std::copy(groupStarts, groupStarts + TypeCount, groupEnds);
+			for (uint32_t i{}; i < count; ++i)
+			{
+				order[groupEnds[m_Materials[pHitRecords[i].materialIndex].index()]++] = i;
+			}
+
+			const ShadeBatch batch{ pHitRecords, pLightDirections, pViewDirections, pColors };
+			ShadeGroup<0>(batch, order.data() + groupStarts[0], order.data() + groupStarts[1]);
+			ShadeGroup<1>(batch, order.data() + groupStarts[1], order.data() + groupStarts[2]);
+			ShadeGroup<2>(batch, order.data() + groupStarts[2], order.data() + groupStarts[3]);
+			ShadeGroup<3>(batch, order.data() + groupStarts[3], order.data() + groupStarts[4]);
+		}
+
+	private:
+		std::vector<Material> m_Materials{};
+
+		struct ShadeBatch
+		{
+			const HitRecord* pHitRecords{};
+			const Vector3* pLightDirections{};
+			const Vector3* pViewDirections{};
+			ColorRGB* pColors{};
+		};
+
+		template<size_t Type>
+		void ShadeGroup(const ShadeBatch& batch, const uint32_t* pBegin, const uint32_t* pEnd) const
+		{
+			for (const uint32_t* pIndex{ pBegin }; pIndex != pEnd; ++pIndex)
+			{
+				const HitRecord& hitRecord{ batch.pHitRecords[*pIndex] };
+				batch.pColors[*pIndex] = std::get_if<Type>(&m_Materials[hitRecord.materialIndex])
+					->Shade(hitRecord, batch.pLightDirections[*pIndex], batch.pViewDirections[*pIndex]);
+			}
+		}
+	};
+#pragma endregion
 }
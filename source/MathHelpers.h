@@ -1,5 +1,7 @@
 #pragma once
+#include <cfloat>
 #include <cmath>
+#include <cstdint>
 
 namespace dae
 {
@@ -25,6 +27,23 @@ namespace dae
 
 	inline bool AreEqual(float a, float b, float epsilon = FLT_EPSILON)
 	{
-		return abs(a - b) < epsilon;
+		return std::abs(a - b) < epsilon;
+	}
+
+	//Spreads the lower 16 bits of x so there is a zero bit between every bit
+	constexpr uint32_t SpreadBits2D(uint32_t x)
+	{
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+
+	//Z-order curve index of a 2D coordinate (16 bits per axis), neighbouring codes are close in both x and y
+	constexpr uint32_t MortonEncode2D(uint32_t x, uint32_t y)
+	{
+		return SpreadBits2D(x) | (SpreadBits2D(y) << 1);
 	}
 }
\ No newline at end of file
@@ -1,51 +1,199 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
 #include "Vector3.h"
 #include "Vector4.h"
 
 namespace dae {
 	struct Matrix
 	{
-		Matrix() = default;
-		Matrix(
+		constexpr Matrix() = default;
+		constexpr Matrix(
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
-		Matrix(
+		constexpr Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
-
-		Matrix(const Matrix& m);
-
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
-		const Matrix& Transpose();
-
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
-
-		static Matrix CreateTranslation(float x, float y, float z);
-		static Matrix CreateTranslation(const Vector3& t);
-		static Matrix CreateRotationX(float pitch);
-		static Matrix CreateRotationY(float yaw);
-		static Matrix CreateRotationZ(float roll);
-		static Matrix CreateRotation(float pitch, float yaw, float roll);
-		static Matrix CreateRotation(const Vector3& r);
-		static Matrix CreateScale(float sx, float sy, float sz);
-		static Matrix CreateScale(const Vector3& s);
-		static Matrix Transpose(const Matrix& m);
-
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
-		Matrix operator*(const Matrix& m) const;
-		const Matrix& operator*=(const Matrix& m);
+			const Vector4& t) :
+			data{ xAxis, yAxis, zAxis, t }
+		{
+		}
+
+		[[nodiscard]] constexpr Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		[[nodiscard]] constexpr Vector3 TransformVector(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z,
+				data[0].y * x + data[1].y * y + data[2].y * z,
+				data[0].z * x + data[1].z * y + data[2].z * z
+			};
+		}
+
+		[[nodiscard]] constexpr Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		[[nodiscard]] constexpr Vector3 TransformPoint(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+			};
+		}
+
+		constexpr const Matrix& Transpose()
+		{
+			*this = Transpose(*this);
+			return *this;
+		}
+
+		[[nodiscard]] constexpr Vector3 GetAxisX() const { return data[0]; }
+		[[nodiscard]] constexpr Vector3 GetAxisY() const { return data[1]; }
+		[[nodiscard]] constexpr Vector3 GetAxisZ() const { return data[2]; }
+		[[nodiscard]] constexpr Vector3 GetTranslation() const { return data[3]; }
+
+		[[nodiscard]] static constexpr Matrix CreateTranslation(float x, float y, float z)
+		{
+			return CreateTranslation(Vector3{ x, y, z });
+		}
+
+		[[nodiscard]] static constexpr Matrix CreateTranslation(const Vector3& t)
+		{
+			return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+		}
+
+		[[nodiscard]] static Matrix CreateRotationX(float pitch)
+		{
+			return {
+				Vector3::UnitX,
+				{ 0.f, std::cos(pitch), -std::sin(pitch) },
+				{ 0.f, std::sin(pitch), std::cos(pitch) },
+				Vector3::Zero };
+		}
+
+		[[nodiscard]] static Matrix CreateRotationY(float yaw)
+		{
+			return {
+				{ std::cos(yaw), 0.f, -std::sin(yaw) },
+				Vector3::UnitY,
+				{ std::sin(yaw), 0.f, std::cos(yaw) },
+				Vector3::Zero };
+		}
+
+		[[nodiscard]] static Matrix CreateRotationZ(float roll)
+		{
+			return {
+				{ std::cos(roll), std::sin(roll), 0.f },
+				{ -std::sin(roll), std::cos(roll), 0.f },
+				Vector3::UnitZ,
+				Vector3::Zero };
+		}
+
+		[[nodiscard]] static Matrix CreateRotation(float pitch, float yaw, float roll)
+		{
+			return CreateRotation({ pitch, yaw, roll });
+		}
+
+		[[nodiscard]] static Matrix CreateRotation(const Vector3& r)
+		{
+			return { CreateRotationX(r.x) * CreateRotationY(r.y) * CreateRotationZ(r.z) };
+		}
+
+		[[nodiscard]] static constexpr Matrix CreateScale(float sx, float sy, float sz)
+		{
+			return {
+				{ sx, 0.f, 0.f },
+				{ 0.f, sy, 0.f },
+				{ 0.f, 0.f, sz },
+				Vector3::Zero
+			};
+		}
+
+		[[nodiscard]] static constexpr Matrix CreateScale(const Vector3& s)
+		{
+			return CreateScale(s.x, s.y, s.z);
+		}
+
+		[[nodiscard]] static constexpr Matrix Transpose(const Matrix& m)
+		{
+			return {
+				Vector4{ m.data[0].x, m.data[1].x, m.data[2].x, m.data[3].x },
+				Vector4{ m.data[0].y, m.data[1].y, m.data[2].y, m.data[3].y },
+				Vector4{ m.data[0].z, m.data[1].z, m.data[2].z, m.data[3].z },
+				Vector4{ m.data[0].w, m.data[1].w, m.data[2].w, m.data[3].w } };
+		}
+
+		//Inverse of an affine transform (last column 0, 0, 0, 1), e.g. world to object space
+		[[nodiscard]] static constexpr Matrix InverseAffine(const Matrix& m)
+		{
+			const Vector3 xAxis{ m.GetAxisX() };
+			const Vector3 yAxis{ m.GetAxisY() };
+			const Vector3 zAxis{ m.GetAxisZ() };
+
+			//The inverse of the 3x3 part has the cofactors as columns
+			const Vector3 yz{ Vector3::Cross(yAxis, zAxis) };
+			const Vector3 zx{ Vector3::Cross(zAxis, xAxis) };
+			const Vector3 xy{ Vector3::Cross(xAxis, yAxis) };
+			const float invDeterminant{ 1.f / Vector3::Dot(xAxis, yz) };
+
+			Matrix inverse{
+				Vector3{ yz.x, zx.x, xy.x } * invDeterminant,
+				Vector3{ yz.y, zx.y, xy.y } * invDeterminant,
+				Vector3{ yz.z, zx.z, xy.z } * invDeterminant,
+				Vector3::Zero };
+			inverse.data[3] = { -inverse.TransformVector(m.GetTranslation()), 1.f };
+			return inverse;
+		}
+
+#pragma region Operator Overloads
+		[[nodiscard]] constexpr Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		[[nodiscard]] constexpr Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		//Row-Major: every result row is the left row combining the rows of m
+		[[nodiscard]] constexpr Matrix operator*(const Matrix& m) const
+		{
+			Matrix result{};
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				result.data[r] =
+					m.data[0] * data[r].x +
+					m.data[1] * data[r].y +
+					m.data[2] * data[r].z +
+					m.data[3] * data[r].w;
+			}
+
+			return result;
+		}
+
+		constexpr const Matrix& operator*=(const Matrix& m)
+		{
+			*this = *this * m;
+			return *this;
+		}
+#pragma endregion
 
 	private:
 
@@ -63,4 +211,4 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
-}
\ No newline at end of file
+}
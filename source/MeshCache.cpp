@@ -0,0 +1,320 @@
+#include "MeshCache.h"
+
+//Standard includes
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr char Magic[8]{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+		constexpr uint32_t ByteOrderMark{ 0x01020304 }; //Reads back differently on a machine with the other byte order
+
+		static_assert(std::is_trivially_copyable_v<Vector3> && sizeof(Vector3) == 12);
+		static_assert(std::is_trivially_copyable_v<BVHNode> && sizeof(BVHNode) == 32);
+		static_assert(std::is_trivially_copyable_v<Matrix> && sizeof(Matrix) == 64);
+
+		//Followed by the arrays in the order of the counts, without padding
+		struct Header
+		{
+			char magic[8]{};
+			uint32_t version{};
+			uint32_t byteOrderMark{};
+			uint64_t sourceSize{};
+			int64_t sourceWriteTime{}; //Native file clock ticks, only compared for equality
+			uint64_t sourceHash{};
+			Matrix bvhTransform{}; //Final transform of the mesh the BVH was built for
+			uint32_t bvhBatchSize{};
+			BVHBuilder bvhBuilder{}; //Was a reserved 0 before, which is BVHBuilder::SAH
+			uint64_t positionCount{};
+			uint64_t normalCount{};
+			uint64_t indexCount{};
+			uint64_t nodeCount{};
+			uint64_t primitiveIndexCount{};
+		};
+
+		struct SourceInfo
+		{
+			uint64_t size{};
+			int64_t writeTime{};
+			uint64_t hash{};
+			bool isHashKnown{ false };
+		};
+
+		enum class CacheState
+		{
+			Missing, //Absent, unreadable or stale: parse the OBJ file
+			Geometry, //Geometry is valid, the BVH was built for another transform
+			Complete
+		};
+
+		//FNV-1a over 64 bit words, the tail byte by byte
+		uint64_t HashBytes(const char* pData, size_t size)
+		{
+			constexpr uint64_t prime{ 0x100000001b3ull };
+			uint64_t hash{ 0xcbf29ce484222325ull };
+
+			size_t i{};
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word{};
+				std::memcpy(&word, pData + i, sizeof(word));
+				hash = (hash ^ word) * prime;
+			}
+			for (; i < size; ++i)
+			{
+				hash = (hash ^ static_cast<unsigned char>(pData[i])) * prime;
+			}
+			return hash;
+		}
+
+		bool GetSourceInfo(const std::string& path, SourceInfo& info)
+		{
+			std::error_code error{};
+			info.size = std::filesystem::file_size(path, error);
+			if (error)
+				return false;
+
+			const auto writeTime{ std::filesystem::last_write_time(path, error) };
+			if (error)
+				return false;
+
+			info.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+			return true;
+		}
+
+		bool HashSource(const std::string& path, SourceInfo& info)
+		{
+			const MappedFile file{ path };
+			if (!file.IsOpen())
+				return false;
+
+			info.hash = HashBytes(file.GetData(), file.GetSize());
+			info.isHashKnown = true;
+			return true;
+		}
+
+		template<typename T>
+		bool ReadArray(const char*& pCurrent, const char* pEnd, uint64_t count, std::vector<T>& values)
+		{
+			if (count > uint64_t(pEnd - pCurrent) / sizeof(T))
+				return false;
+
+			values.resize(count);
+			std::memcpy(values.data(), pCurrent, count * sizeof(T));
+			pCurrent += count * sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		void WriteArray(std::ofstream& file, const std::vector<T>& values)
+		{
+			file.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+		}
+
+		//Sizes that fit the file are not enough, a corrupt cache must not make BuildTriangles or the traversal read out of bounds
+		bool IsGeometryValid(const TriangleMesh& mesh)
+		{
+			if (mesh.indices.size() % 3 != 0 || mesh.normals.size() != mesh.indices.size() / 3)
+				return false;
+
+			return std::all_of(mesh.indices.begin(), mesh.indices.end(), [&mesh](int index)
+				{
+					return index >= 0 && size_t(index) < mesh.positions.size();
+				});
+		}
+
+		//Every range inside its array, children after their parent (no cycles, what BVH::Refit relies on) and
+		//no deeper than the fixed traversal stacks allow
+		bool IsHierarchyValid(const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& primitiveIndices, size_t primitiveCount)
+		{
+			if (nodes.empty())
+				return primitiveIndices.empty() && primitiveCount == 0;
+
+			if (primitiveIndices.size() != primitiveCount)
+				return false;
+
+			for (const uint32_t primitiveIndex : primitiveIndices)
+			{
+				if (primitiveIndex >= primitiveCount)
+					return false;
+			}
+
+			std::vector<uint32_t> depths(nodes.size(), 0);
+			depths[0] = 1;
+			for (size_t nodeIndex{}; nodeIndex < nodes.size(); ++nodeIndex)
+			{
+				const BVHNode& node{ nodes[nodeIndex] };
+				if (depths[nodeIndex] == 0 || depths[nodeIndex] > BVH::MaxDepth)
+					return false;
+
+				if (node.IsLeaf())
+				{
+					if (uint64_t(node.leftFirst) + node.primitiveCount > primitiveIndices.size())
+						return false;
+					continue;
+				}
+
+				if (node.leftFirst <= nodeIndex || uint64_t(node.leftFirst) + 1 >= nodes.size())
+					return false;
+
+				depths[node.leftFirst] = std::max(depths[node.leftFirst], depths[nodeIndex] + 1);
+				depths[node.leftFirst + 1] = std::max(depths[node.leftFirst + 1], depths[nodeIndex] + 1);
+			}
+			return true;
+		}
+
+		CacheState ReadCache(const std::string& objPath, SourceInfo& source, TriangleMesh& mesh, bool& isHeaderStale)
+		{
+			const MappedFile file{ MeshCache::GetCachePath(objPath) };
+			if (!file.IsOpen() || file.GetSize() < sizeof(Header))
+				return CacheState::Missing;
+
+			Header header{};
+			std::memcpy(&header, file.GetData(), sizeof(Header));
+			if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != MeshCache::Version || header.byteOrderMark != ByteOrderMark)
+				return CacheState::Missing;
+
+			//Same size and time: trust the stored hash, the content only has to be hashed when the time changed
+			if (header.sourceSize != source.size)
+				return CacheState::Missing;
+
+			isHeaderStale = header.sourceWriteTime != source.writeTime;
+			if (isHeaderStale && (!HashSource(objPath, source) || source.hash != header.sourceHash))
+				return CacheState::Missing;
+
+			source.hash = header.sourceHash;
+			source.isHashKnown = true;
+
+			const char* pCurrent{ file.GetData() + sizeof(Header) };
+			const char* pEnd{ file.GetData() + file.GetSize() };
+
+			std::vector<BVHNode> nodes{};
+			std::vector<uint32_t> primitiveIndices{};
+			if (!ReadArray(pCurrent, pEnd, header.positionCount, mesh.positions) ||
+				!ReadArray(pCurrent, pEnd, header.normalCount, mesh.normals) ||
+				!ReadArray(pCurrent, pEnd, header.indexCount, mesh.indices) ||
+				!ReadArray(pCurrent, pEnd, header.nodeCount, nodes) ||
+				!ReadArray(pCurrent, pEnd, header.primitiveIndexCount, primitiveIndices) ||
+				!IsGeometryValid(mesh) || !IsHierarchyValid(nodes, primitiveIndices, mesh.indices.size() / 3))
+			{
+				mesh.positions.clear();
+				mesh.normals.clear();
+				mesh.indices.clear();
+				return CacheState::Missing;
+			}
+
+			//Bitwise, the cached BVH is only exact for the very same transform
+			const Matrix transform{ mesh.GetFinalTransform() };
+			if (std::memcmp(&header.bvhTransform, &transform, sizeof(Matrix)) != 0 || header.bvhBatchSize != MaxSimdWidth || header.bvhBuilder != mesh.bvhBuilder)
+				return CacheState::Geometry;
+
+			mesh.bvh.Assign(std::move(nodes), std::move(primitiveIndices), header.bvhBatchSize);
+			return CacheState::Complete;
+		}
+
+		//Written to a temporary file first so concurrent readers never see half a cache
+		bool WriteCache(const std::string& objPath, const SourceInfo& source, const TriangleMesh& mesh)
+		{
+			const std::string cachePath{ MeshCache::GetCachePath(objPath) };
+			const std::string temporaryPath{ cachePath + ".tmp" };
+
+			Header header{};
+			std::memcpy(header.magic, Magic, sizeof(Magic));
+			header.version = MeshCache::Version;
+			header.byteOrderMark = ByteOrderMark;
+			header.sourceSize = source.size;
+			header.sourceWriteTime = source.writeTime;
+			header.sourceHash = source.hash;
+			header.bvhTransform = mesh.GetFinalTransform();
+			header.bvhBatchSize = mesh.bvh.GetBatchSize();
+			header.bvhBuilder = mesh.bvhBuilder;
+			header.positionCount = mesh.positions.size();
+			header.normalCount = mesh.normals.size();
+			header.indexCount = mesh.indices.size();
+			header.nodeCount = mesh.bvh.GetNodes().size();
+			header.primitiveIndexCount = mesh.bvh.GetPrimitiveIndices().size();
+
+			{
+				std::ofstream file{ temporaryPath, std::ios::binary };
+				if (!file)
+					return false;
+
+				file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+				WriteArray(file, mesh.positions);
+				WriteArray(file, mesh.normals);
+				WriteArray(file, mesh.indices);
+				WriteArray(file, mesh.bvh.GetNodes());
+				WriteArray(file, mesh.bvh.GetPrimitiveIndices());
+
+				if (!file.flush())
+				{
+					file.close();
+					std::error_code error{};
+					std::filesystem::remove(temporaryPath, error);
+					return false;
+				}
+			}
+
+			std::error_code error{};
+			std::filesystem::rename(temporaryPath, cachePath, error);
+			if (!error)
+				return true;
+
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+	}
+
+	namespace MeshCache
+	{
+		std::string GetCachePath(const std::string& objPath)
+		{
+			return objPath + ".meshcache";
+		}
+
+		bool LoadOBJ(const std::string& objPath, TriangleMesh& mesh, ThreadPool* pThreadPool)
+		{
+			SourceInfo source{};
+			if (!GetSourceInfo(objPath, source))
+				return false;
+
+			bool isHeaderStale{ false };
+			const CacheState state{ ReadCache(objPath, source, mesh, isHeaderStale) };
+
+			if (state == CacheState::Missing)
+			{
+				mesh.positions.clear();
+				mesh.normals.clear();
+				mesh.indices.clear();
+				if (!ObjLoader::Load(objPath, mesh.positions, mesh.normals, mesh.indices, pThreadPool))
+					return false;
+			}
+
+			mesh.TransformVertices();
+			if (state != CacheState::Complete)
+				mesh.BuildBVH(pThreadPool);
+			mesh.BuildTriangles();
+
+			//A cache that cannot be written (e.g. read-only asset directory) only costs the next start up time
+			if (state != CacheState::Complete || isHeaderStale)
+			{
+				if (source.isHashKnown || HashSource(objPath, source))
+					WriteCache(objPath, source, mesh);
+			}
+
+			return true;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	class ThreadPool;
+	struct TriangleMesh;
+
+	//Binary cache of a parsed OBJ file and its mesh BVH, stored next to the asset as "<asset>.meshcache".
+	//The cache is valid while the asset has the same size and modification time, or, when only the time
+	//changed (copied or touched files), the same content hash. The BVH part is only used when the mesh has
+	//the transform and builder it was built with, otherwise it is rebuilt and the cache rewritten.
+	namespace MeshCache
+	{
+		//Bump when the file layout or anything the cached data depends on (OBJ parsing, BVH builders) changes
+		constexpr uint32_t Version{ 2 };
+
+		/**
+		 * \brief Fills the mesh from the cache of the OBJ file, or parses the OBJ file and writes the cache.
+		 * Set the mesh's transform and BVH builder first, the mesh is ready to render afterwards (no UpdateTransforms needed).
+		 * \param objPath OBJ file, its cache lives in the same directory
+		 * \param mesh mesh without geometry yet
+		 * \param pThreadPool threads to parse the OBJ file and build the BVH with, nullptr parses on a pool of its own and
+		 * builds the BVH on the calling thread
+		 * \return false when neither the cache nor the OBJ file could be loaded
+		 */
+		bool LoadOBJ(const std::string& objPath, TriangleMesh& mesh, ThreadPool* pThreadPool = nullptr);
+
+		std::string GetCachePath(const std::string& objPath);
+	}
+}
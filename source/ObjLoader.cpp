@@ -0,0 +1,271 @@
+#include "ObjLoader.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+//Project includes
+#include "MappedFile.h"
+#include "Math.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bytes one thread parses at once, files smaller than this are parsed on the calling thread
+		constexpr size_t ChunkSize{ 1 << 20 };
+
+		//Triangles of one line range, before the ranges are stitched together
+		struct Chunk
+		{
+			std::string_view text{};
+			std::vector<Vector3> positions{};
+			std::vector<int> indices{}; //0 based into the whole file, or into this chunk for the ones listed in relativeIndices
+			std::vector<uint32_t> relativeIndices{}; //Positions in indices that came from negative references
+			size_t positionOffset{}; //Vertices in all chunks before this one
+			size_t indexOffset{};
+			bool isValid{ true };
+		};
+
+		bool IsBlank(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		const char* SkipBlanks(const char* pCurrent, const char* pEnd)
+		{
+			while (pCurrent < pEnd && IsBlank(*pCurrent))
+				++pCurrent;
+			return pCurrent;
+		}
+
+		bool ParseFloat(const char*& pCurrent, const char* pEnd, float& value)
+		{
+			pCurrent = SkipBlanks(pCurrent, pEnd);
+
+			//from_chars does not accept an explicit plus sign
+			if (pCurrent < pEnd && *pCurrent == '+')
+				++pCurrent;
+
+			const auto [pNext, error] = std::from_chars(pCurrent, pEnd, value);
+			pCurrent = pNext;
+			return error == std::errc{};
+		}
+
+		//"v x y z [w | r g b]"
+		bool ParseVertex(const char* pCurrent, const char* pEnd, Chunk& chunk)
+		{
+			Vector3 position{};
+			if (!ParseFloat(pCurrent, pEnd, position.x) || !ParseFloat(pCurrent, pEnd, position.y) || !ParseFloat(pCurrent, pEnd, position.z))
+				return false;
+
+			chunk.positions.push_back(position);
+			return true;
+		}
+
+		//"f v1[/vt1][/vn1] v2... v3... [v4...]", only the vertex index of every reference is kept
+		bool ParseFace(const char* pCurrent, const char* pEnd, Chunk& chunk)
+		{
+			//Index and whether it is relative to this chunk, for the first and previous reference of the fan
+			int references[2]{};
+			bool isRelative[2]{};
+			uint32_t vertexCount{};
+
+			while (true)
+			{
+				pCurrent = SkipBlanks(pCurrent, pEnd);
+				if (pCurrent == pEnd)
+					break;
+
+				int reference{};
+				const auto [pNext, error] = std::from_chars(pCurrent, pEnd, reference);
+				if (error != std::errc{} || reference == 0)
+					return false;
+
+				//Skip the texture coordinate and normal references
+				pCurrent = pNext;
+				while (pCurrent < pEnd && !IsBlank(*pCurrent))
+					++pCurrent;
+
+				//Negative references count back from the last vertex read, which is only known
+				//within this chunk until the vertex counts of the chunks before it are summed up
+				const bool isCurrentRelative{ reference < 0 };
+				const int index{ isCurrentRelative ? static_cast<int>(chunk.positions.size()) + reference : reference - 1 };
+
+				if (vertexCount >= 2)
+				{
+					//Fan triangulation: first, previous, current
+					const int triangle[3]{ references[0], references[1], index };
+					const bool isTriangleRelative[3]{ isRelative[0], isRelative[1], isCurrentRelative };
+					for (int i{}; i < 3; ++i)
+					{
+						if (isTriangleRelative[i])
+							chunk.relativeIndices.push_back(static_cast<uint32_t>(chunk.indices.size()));
+						chunk.indices.push_back(triangle[i]);
+					}
+				}
+
+				const int slot{ vertexCount == 0 ? 0 : 1 };
+				references[slot] = index;
+				isRelative[slot] = isCurrentRelative;
+				++vertexCount;
+			}
+
+			return vertexCount >= 3;
+		}
+
+		void ParseChunk(Chunk& chunk)
+		{
+			const char* pCurrent{ chunk.text.data() };
+			const char* pEnd{ pCurrent + chunk.text.size() };
+
+			while (pCurrent < pEnd && chunk.isValid)
+			{
+				const char* pLineEnd{ static_cast<const char*>(std::memchr(pCurrent, '\n', pEnd - pCurrent)) };
+				if (!pLineEnd)
+					pLineEnd = pEnd;
+
+				//Strip comments, they may also follow a statement
+				const char* pComment{ static_cast<const char*>(std::memchr(pCurrent, '#', pLineEnd - pCurrent)) };
+				const char* pStatementEnd{ pComment ? pComment : pLineEnd };
+
+				pCurrent = SkipBlanks(pCurrent, pStatementEnd);
+				if (pStatementEnd - pCurrent >= 2 && IsBlank(pCurrent[1]))
+				{
+					if (pCurrent[0] == 'v')
+						chunk.isValid = ParseVertex(pCurrent + 2, pStatementEnd, chunk);
+					else if (pCurrent[0] == 'f')
+						chunk.isValid = ParseFace(pCurrent + 2, pStatementEnd, chunk);
+				}
+
+				pCurrent = pLineEnd + 1;
+			}
+		}
+
+		//Splits the text in ranges of about ChunkSize bytes that end on a line break
+		std::vector<Chunk> SplitInChunks(std::string_view text)
+		{
+			std::vector<Chunk> chunks{};
+			size_t begin{};
+			while (begin < text.size())
+			{
+				size_t end{ std::min(begin + ChunkSize, text.size()) };
+				if (end < text.size())
+				{
+					const size_t lineBreak{ text.find('\n', end) };
+					end = lineBreak == std::string_view::npos ? text.size() : lineBreak + 1;
+				}
+
+				chunks.emplace_back().text = text.substr(begin, end - begin);
+				begin = end;
+			}
+			return chunks;
+		}
+	}
+
+	namespace ObjLoader
+	{
+		bool Load(const std::string& path, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, ThreadPool* pThreadPool)
+		{
+			const MappedFile file{ path };
+			if (!file.IsOpen())
+				return false;
+
+			std::vector<Chunk> chunks{ SplitInChunks(file.GetView()) };
+			const uint32_t chunkCount{ static_cast<uint32_t>(chunks.size()) };
+
+			//Without a pool of the caller, only start threads when there is more than one chunk to parse
+			std::optional<ThreadPool> localThreadPool{};
+			ThreadPool& threadPool{ pThreadPool ? *pThreadPool : localThreadPool.emplace(chunkCount > 1 ? 0u : 1u) };
+
+			threadPool.ParallelFor(chunkCount, 1, [&chunks](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						ParseChunk(chunks[i]);
+					}
+				});
+
+			//Where every chunk goes in the output, vertices already in positions come first
+			const size_t firstPosition{ positions.size() };
+			const size_t firstIndex{ indices.size() };
+			size_t positionCount{ firstPosition };
+			size_t indexCount{ firstIndex };
+			for (Chunk& chunk : chunks)
+			{
+				if (!chunk.isValid)
+					return false;
+
+				chunk.positionOffset = positionCount;
+				chunk.indexOffset = indexCount;
+				positionCount += chunk.positions.size();
+				indexCount += chunk.indices.size();
+			}
+
+			positions.resize(positionCount);
+			indices.resize(indexCount);
+
+			//Copy every chunk to its place and make its indices absolute
+			std::atomic<bool> isValid{ true };
+			threadPool.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						Chunk& chunk{ chunks[i] };
+						const int chunkOffset{ static_cast<int>(chunk.positionOffset - firstPosition) };
+
+						for (const uint32_t relativeIndex : chunk.relativeIndices)
+						{
+							chunk.indices[relativeIndex] += chunkOffset;
+						}
+
+						std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionOffset);
+
+						int* pIndices{ indices.data() + chunk.indexOffset };
+						for (const int index : chunk.indices)
+						{
+							if (index < 0 || size_t(index) >= positionCount - firstPosition)
+								isValid = false;
+							*pIndices++ = index + static_cast<int>(firstPosition);
+						}
+
+						//Free the chunk's copy right away, large files would otherwise need twice the memory
+						chunk.positions = {};
+						chunk.indices = {};
+					}
+				});
+
+			if (!isValid)
+			{
+				positions.resize(firstPosition);
+				indices.resize(firstIndex);
+				return false;
+			}
+
+			//Precompute normals
+			const size_t firstNormal{ normals.size() };
+			const uint32_t triangleCount{ static_cast<uint32_t>((indexCount - firstIndex) / 3) };
+			normals.resize(firstNormal + triangleCount);
+
+			threadPool.ParallelFor(triangleCount, 4096, [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t triangle{ begin }; triangle < end; ++triangle)
+					{
+						const int* pTriangle{ indices.data() + firstIndex + size_t(triangle) * 3 };
+						const Vector3 edgeV0V1{ positions[pTriangle[1]] - positions[pTriangle[0]] };
+						const Vector3 edgeV0V2{ positions[pTriangle[2]] - positions[pTriangle[0]] };
+
+						normals[firstNormal + triangle] = Vector3::Cross(edgeV0V1, edgeV0V2).Normalized();
+					}
+				});
+
+			return true;
+		}
+	}
+}
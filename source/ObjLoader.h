@@ -0,0 +1,30 @@
+#pragma once
+
+//Standard includes
+#include <string>
+#include <vector>
+
+//Project includes
+#include "Vector3.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	namespace ObjLoader
+	{
+		/**
+		 * \brief Loads the triangles of a Wavefront OBJ file. The file is memory mapped and split in line ranges
+		 * that are parsed on all threads of the pool. Faces may use v, v/vt, v//vn and v/vt/vn references, negative (relative)
+		 * indices and any number of vertices; polygons are triangulated as a fan. Texture coordinates, normals
+		 * and all other statements are skipped, normals are computed per triangle like before.
+		 * \param path OBJ file
+		 * \param positions receives the vertices, appended to what is already there
+		 * \param normals receives one normal per triangle
+		 * \param indices receives three indices per triangle into positions
+		 * \param pThreadPool threads to parse with, nullptr starts a pool of its own (on all cores) for the call
+		 * \return false when the file cannot be read or a face references a vertex that does not exist
+		 */
+		bool Load(const std::string& path, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, ThreadPool* pThreadPool = nullptr);
+	}
+}
@@ -0,0 +1,511 @@
+#pragma once
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+#include "BVH.h"
+#include "DataTypes.h"
+#include "Simd.h"
+#include "Statistics.h"
+#include "Utils.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace dae
+{
+	//Four neighbouring rays (the primary rays of a 2x2 pixel quad, or the shadow rays of neighbouring hits)
+	//traced together so every BVH node and primitive is fetched once for all of them. Stored per component.
+	struct alignas(16) RayPacket
+	{
+		static constexpr uint32_t Size{ 4 };
+		static constexpr int FullMask{ (1 << Size) - 1 };
+
+		float originX[Size]{};
+		float originY[Size]{};
+		float originZ[Size]{};
+		float directionX[Size]{};
+		float directionY[Size]{};
+		float directionZ[Size]{};
+		float max[Size]{ FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+		float min{ 0.0001f }; //Shared by all rays
+
+		void SetRay(uint32_t lane, const Ray& ray)
+		{
+			originX[lane] = ray.origin.x;
+			originY[lane] = ray.origin.y;
+			originZ[lane] = ray.origin.z;
+			directionX[lane] = ray.direction.x;
+			directionY[lane] = ray.direction.y;
+			directionZ[lane] = ray.direction.z;
+			max[lane] = ray.max;
+		}
+
+		Ray GetRay(uint32_t lane) const
+		{
+			return { { originX[lane], originY[lane], originZ[lane] }, { directionX[lane], directionY[lane], directionZ[lane] }, min, max[lane] };
+		}
+
+		//The packet shares one front to back order, which only holds for rays pointing into the same octant
+		bool IsCoherent() const
+		{
+			for (uint32_t lane{ 1 }; lane < Size; ++lane)
+			{
+				if (std::signbit(directionX[lane]) != std::signbit(directionX[0]) ||
+					std::signbit(directionY[lane]) != std::signbit(directionY[0]) ||
+					std::signbit(directionZ[lane]) != std::signbit(directionZ[0]))
+					return false;
+			}
+			return true;
+		}
+	};
+
+#if defined(DAE_SIMD_X86)
+	namespace PacketUtils
+	{
+		//Packet in SSE registers, one lane per ray
+		struct PacketRegisters
+		{
+			explicit PacketRegisters(const RayPacket& packet)
+				: originX{ _mm_load_ps(packet.originX) }
+				, originY{ _mm_load_ps(packet.originY) }
+				, originZ{ _mm_load_ps(packet.originZ) }
+				, directionX{ _mm_load_ps(packet.directionX) }
+				, directionY{ _mm_load_ps(packet.directionY) }
+				, directionZ{ _mm_load_ps(packet.directionZ) }
+				, invDirectionX{ _mm_div_ps(_mm_set1_ps(1.f), directionX) }
+				, invDirectionY{ _mm_div_ps(_mm_set1_ps(1.f), directionY) }
+				, invDirectionZ{ _mm_div_ps(_mm_set1_ps(1.f), directionZ) }
+				, min{ _mm_set1_ps(packet.min) }
+				, kernelWidth{ Simd::GetWidth() }
+			{
+			}
+
+			__m128 originX, originY, originZ;
+			__m128 directionX, directionY, directionZ;
+			__m128 invDirectionX, invDirectionY, invDirectionZ;
+			__m128 min;
+			uint32_t kernelWidth; //Primitives the single ray kernels test at once
+		};
+
+		//Keeps the lanes of value where mask is set, takes the lanes of other elsewhere
+		inline __m128 Select(__m128 mask, __m128 value, __m128 other)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, other));
+		}
+
+		//All bits set in the lanes whose bit is set in laneMask (bit per lane, like _mm_movemask_ps returns)
+		inline __m128 ToLanes(int laneMask)
+		{
+			const __m128i laneBits{ _mm_and_si128(_mm_set1_epi32(laneMask), _mm_setr_epi32(1, 2, 4, 8)) };
+			return _mm_castsi128_ps(_mm_cmpgt_epi32(laneBits, _mm_setzero_si128()));
+		}
+
+		/**
+		 * \brief Whether testing the primitives one by one against the packet beats handing every active ray to the
+		 * single ray kernels, which test kernelWidth primitives at once. With 8-wide kernels that only holds for
+		 * ranges of a few primitives.
+		 */
+		inline bool IsPacketTestCheaper(uint32_t primitiveCount, int laneMask, uint32_t kernelWidth)
+		{
+			const uint32_t batchCount{ (primitiveCount + kernelWidth - 1) / kernelWidth };
+			return primitiveCount < static_cast<uint32_t>(std::popcount(static_cast<uint32_t>(laneMask))) * batchCount;
+		}
+
+		//Smallest of the four lanes
+		inline float HorizontalMin(__m128 value)
+		{
+			value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+			value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+			return _mm_cvtss_f32(value);
+		}
+
+		/**
+		 * \brief Slab test of the four rays, lane for lane the same comparisons as GeometryUtils::HitTest_AABB
+		 * \param bounds box to test
+		 * \param rays packet registers
+		 * \param max closest hit so far per ray
+		 * \return entry distance per ray, FLT_MAX in the lanes that miss
+		 */
+		inline __m128 HitTest_AABB(const AABB& bounds, const PacketRegisters& rays, __m128 max)
+		{
+			const __m128 tx1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.x), rays.originX), rays.invDirectionX) };
+			const __m128 tx2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.max.x), rays.originX), rays.invDirectionX) };
+			__m128 tMin{ _mm_min_ps(tx2, tx1) };
+			__m128 tMax{ _mm_max_ps(tx2, tx1) };
+
+			const __m128 ty1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.y), rays.originY), rays.invDirectionY) };
+			const __m128 ty2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.max.y), rays.originY), rays.invDirectionY) };
+			tMin = _mm_max_ps(_mm_min_ps(ty2, ty1), tMin);
+			tMax = _mm_min_ps(_mm_max_ps(ty2, ty1), tMax);
+
+			const __m128 tz1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.z), rays.originZ), rays.invDirectionZ) };
+			const __m128 tz2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds.max.z), rays.originZ), rays.invDirectionZ) };
+			tMin = _mm_max_ps(_mm_min_ps(tz2, tz1), tMin);
+			tMax = _mm_min_ps(_mm_max_ps(tz2, tz1), tMax);
+
+			const __m128 hit{ _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(tMax, tMin), _mm_cmpge_ps(tMax, rays.min)), _mm_cmple_ps(tMin, max)) };
+			return Select(hit, tMin, _mm_set1_ps(FLT_MAX));
+		}
+
+		/**
+		 * \brief Moller-Trumbore of one precomputed triangle against the four rays, same operation order as the single ray kernels
+		 * \param triangles precomputed triangle store
+		 * \param index triangle to test
+		 * \param rays packet registers
+		 * \param max closest hit so far per ray
+		 * \param cullMode cull mode to apply
+		 * \param t receives the distance per ray, only meaningful in the lanes that hit
+		 * \return lanes that hit within [min, max]
+		 */
+		inline __m128 HitTest_Triangle(const TriangleSoA& triangles, uint32_t index, const PacketRegisters& rays, __m128 max, TriangleCullMode cullMode, __m128& t)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+
+			const __m128 edge1X{ _mm_set1_ps(triangles.edge1X[index]) };
+			const __m128 edge1Y{ _mm_set1_ps(triangles.edge1Y[index]) };
+			const __m128 edge1Z{ _mm_set1_ps(triangles.edge1Z[index]) };
+			const __m128 edge2X{ _mm_set1_ps(triangles.edge2X[index]) };
+			const __m128 edge2Y{ _mm_set1_ps(triangles.edge2Y[index]) };
+			const __m128 edge2Z{ _mm_set1_ps(triangles.edge2Z[index]) };
+
+			//pVector = Cross(direction, edge2), det = Dot(edge1, pVector)
+			const __m128 pX{ _mm_sub_ps(_mm_mul_ps(rays.directionY, edge2Z), _mm_mul_ps(rays.directionZ, edge2Y)) };
+			const __m128 pY{ _mm_sub_ps(_mm_mul_ps(rays.directionZ, edge2X), _mm_mul_ps(rays.directionX, edge2Z)) };
+			const __m128 pZ{ _mm_sub_ps(_mm_mul_ps(rays.directionX, edge2Y), _mm_mul_ps(rays.directionY, edge2X)) };
+			const __m128 det{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ)) };
+
+			__m128 valid{};
+			switch (cullMode)
+			{
+			case TriangleCullMode::BackFaceCulling:
+				valid = _mm_cmpgt_ps(det, zero);
+				break;
+			case TriangleCullMode::FrontFaceCulling:
+				valid = _mm_cmplt_ps(det, zero);
+				break;
+			default:
+				valid = _mm_cmpneq_ps(det, zero);
+				break;
+			}
+			if (_mm_movemask_ps(valid) == 0)
+				return valid;
+
+			const __m128 invDet{ _mm_div_ps(one, det) };
+			const __m128 tX{ _mm_sub_ps(rays.originX, _mm_set1_ps(triangles.v0X[index])) };
+			const __m128 tY{ _mm_sub_ps(rays.originY, _mm_set1_ps(triangles.v0Y[index])) };
+			const __m128 tZ{ _mm_sub_ps(rays.originZ, _mm_set1_ps(triangles.v0Z[index])) };
+
+			const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tX, pX), _mm_mul_ps(tY, pY)), _mm_mul_ps(tZ, pZ)), invDet) };
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+			//qVector = Cross(tVector, edge1)
+			const __m128 qX{ _mm_sub_ps(_mm_mul_ps(tY, edge1Z), _mm_mul_ps(tZ, edge1Y)) };
+			const __m128 qY{ _mm_sub_ps(_mm_mul_ps(tZ, edge1X), _mm_mul_ps(tX, edge1Z)) };
+			const __m128 qZ{ _mm_sub_ps(_mm_mul_ps(tX, edge1Y), _mm_mul_ps(tY, edge1X)) };
+
+			const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.directionX, qX), _mm_mul_ps(rays.directionY, qY)), _mm_mul_ps(rays.directionZ, qZ)), invDet) };
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+			t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), invDet);
+			return _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, rays.min), _mm_cmple_ps(t, max)));
+		}
+
+		/**
+		 * \brief Nearest root test of one sphere against the four rays, same math as the batched sphere kernels
+		 * \param spheres sphere store
+		 * \param index sphere to test
+		 * \param rays packet registers
+		 * \param max closest hit so far per ray
+		 * \param t receives the distance per ray, only meaningful in the lanes that hit
+		 * \return lanes that hit within [min, max]
+		 */
+		inline __m128 HitTest_Sphere(const SphereSoA& spheres, uint32_t index, const PacketRegisters& rays, __m128 max, __m128& t)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+
+			const __m128 toCenterX{ _mm_sub_ps(rays.originX, _mm_set1_ps(spheres.originX[index])) };
+			const __m128 toCenterY{ _mm_sub_ps(rays.originY, _mm_set1_ps(spheres.originY[index])) };
+			const __m128 toCenterZ{ _mm_sub_ps(rays.originZ, _mm_set1_ps(spheres.originZ[index])) };
+			const __m128 radius{ _mm_set1_ps(spheres.radius[index]) };
+
+			//Half-b form of the quadratic
+			const __m128 a{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.directionX, rays.directionX), _mm_mul_ps(rays.directionY, rays.directionY)), _mm_mul_ps(rays.directionZ, rays.directionZ)) };
+			const __m128 halfB{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.directionX, toCenterX), _mm_mul_ps(rays.directionY, toCenterY)), _mm_mul_ps(rays.directionZ, toCenterZ)) };
+			const __m128 c{ _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toCenterX, toCenterX), _mm_mul_ps(toCenterY, toCenterY)), _mm_mul_ps(toCenterZ, toCenterZ)), _mm_mul_ps(radius, radius)) };
+			const __m128 discriminant{ _mm_sub_ps(_mm_mul_ps(halfB, halfB), _mm_mul_ps(a, c)) };
+
+			const __m128 valid{ _mm_cmpge_ps(discriminant, zero) };
+			if (_mm_movemask_ps(valid) == 0)
+				return valid;
+
+			t = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, halfB), _mm_sqrt_ps(_mm_max_ps(discriminant, zero))), a);
+			return _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, rays.min), _mm_cmple_ps(t, max)));
+		}
+
+		/**
+		 * \brief Walks a BVH front to back with the whole packet. A node is entered when any of its active rays hits
+		 * it, only those rays stay active below it. Children are ordered by the nearest entry of the packet.
+		 * \param bvh hierarchy to traverse
+		 * \param rays packet registers
+		 * \param activeMask rays to trace (bit per lane)
+		 * \param max closest hit so far per ray, the callback shortens it to cull farther nodes
+		 * \param leafCallback int(uint32_t first, uint32_t count, int laneMask) over the BVH ordered primitive range,
+		 * returns the rays that are done (e.g. occluded shadow rays), the traversal ends when all of them are
+		 */
+		template<typename LeafCallback>
+		inline void TraverseBVH(const BVH& bvh, const PacketRegisters& rays, int activeMask, __m128& max, LeafCallback&& leafCallback)
+		{
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			if (nodes.empty())
+				return;
+
+			const __m128 noHit{ _mm_set1_ps(FLT_MAX) };
+			const __m128 rootDistances{ HitTest_AABB(nodes[0].bounds, rays, max) };
+			int laneMask{ activeMask & _mm_movemask_ps(_mm_cmplt_ps(rootDistances, noHit)) };
+			if (laneMask == 0)
+				return;
+
+			//Entry distances are kept with every postponed node, rays that found a closer hit by the time it is popped drop out
+			uint32_t stack[BVH::MaxDepth]{};
+			__m128 stackDistances[BVH::MaxDepth];
+			uint32_t stackSize{ 0 };
+			uint32_t nodeIndex{ 0 };
+			while (true)
+			{
+				DAE_STATISTICS_INCREMENT(bvhNodesVisited);
+
+				const BVHNode& node{ nodes[nodeIndex] };
+				if (node.IsLeaf())
+				{
+					activeMask &= ~leafCallback(node.leftFirst, node.primitiveCount, laneMask);
+					if (activeMask == 0)
+						return;
+				}
+				else
+				{
+					uint32_t nearIndex{ node.leftFirst };
+					uint32_t farIndex{ node.leftFirst + 1 };
+					__m128 nearDistances{ HitTest_AABB(nodes[nearIndex].bounds, rays, max) };
+					__m128 farDistances{ HitTest_AABB(nodes[farIndex].bounds, rays, max) };
+					int nearMask{ laneMask & _mm_movemask_ps(_mm_cmplt_ps(nearDistances, noHit)) };
+					int farMask{ laneMask & _mm_movemask_ps(_mm_cmplt_ps(farDistances, noHit)) };
+
+					//Lanes outside the mask must not decide the order
+					const __m128 activeLanes{ ToLanes(laneMask) };
+					if (HorizontalMin(Select(activeLanes, farDistances, noHit)) < HorizontalMin(Select(activeLanes, nearDistances, noHit)))
+					{
+						std::swap(nearIndex, farIndex);
+						std::swap(nearDistances, farDistances);
+						std::swap(nearMask, farMask);
+					}
+
+					if (nearMask != 0)
+					{
+						if (farMask != 0)
+						{
+							stack[stackSize] = farIndex;
+							stackDistances[stackSize++] = Select(activeLanes, farDistances, noHit);
+						}
+
+						nodeIndex = nearIndex;
+						laneMask = nearMask;
+						continue;
+					}
+
+					if (farMask != 0)
+					{
+						nodeIndex = farIndex;
+						laneMask = farMask;
+						continue;
+					}
+				}
+
+				//Pop the next node that still has an active ray which could hit something closer in it
+				laneMask = 0;
+				while (laneMask == 0 && stackSize > 0)
+				{
+					--stackSize;
+					const __m128 distances{ stackDistances[stackSize] };
+					laneMask = activeMask & _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(distances, noHit), _mm_cmple_ps(distances, max)));
+					nodeIndex = stack[stackSize];
+				}
+
+				if (laneMask == 0)
+					return;
+			}
+		}
+
+		/**
+		 * \brief Closest (or any) hits of the packet with a mesh. Leaves reached by fewer rays than it takes to
+		 * pay off are handed ray by ray to the single ray kernel, which tests a whole batch of triangles at once.
+		 * \param mesh mesh to test
+		 * \param packet packet the registers were loaded from
+		 * \param rays packet registers
+		 * \param activeMask rays to trace (bit per lane)
+		 * \param cullMode cull mode to apply (already flipped for shadow rays)
+		 * \param anyHit a ray is done with its first hit, max is left alone
+		 * \param max closest hit so far per ray, shortened to the hits found
+		 * \param pTriangleIndices receives the (closest or first) hit triangle of the rays that hit the mesh, may be nullptr for any hit tests
+		 * \return rays whose closest hit is now on this mesh, or that hit it at all for any hit tests
+		 */
+		inline int HitTest_TriangleMesh(const TriangleMesh& mesh, const RayPacket& packet, const PacketRegisters& rays, int activeMask,
+			TriangleCullMode cullMode, bool anyHit, __m128& max, uint32_t* pTriangleIndices)
+		{
+			int hitMask{ 0 };
+			TraverseBVH(mesh.bvh, rays, activeMask, max, [&](uint32_t first, uint32_t count, int laneMask)
+				{
+					int leafHitMask{ 0 };
+					if (!IsPacketTestCheaper(count, laneMask, rays.kernelWidth))
+					{
+						alignas(16) float laneMax[RayPacket::Size];
+						_mm_store_ps(laneMax, max);
+
+						for (int lanes{ laneMask }; lanes != 0; lanes &= lanes - 1)
+						{
+							const int lane{ std::countr_zero(static_cast<uint32_t>(lanes)) };
+							Ray ray{ packet.GetRay(lane) };
+							ray.max = laneMax[lane];
+
+							const uint32_t hitIndex{ Simd::IntersectTriangles(mesh.triangles, first, count, ray, cullMode, anyHit) };
+							if (hitIndex == UINT32_MAX)
+								continue;
+
+							leafHitMask |= 1 << lane;
+							if (pTriangleIndices)
+								pTriangleIndices[lane] = hitIndex;
+							if (!anyHit)
+								laneMax[lane] = ray.max;
+						}
+
+						if (!anyHit)
+							max = _mm_load_ps(laneMax);
+					}
+					else
+					{
+						DAE_STATISTICS_ADD(triangleTests, count * std::popcount(static_cast<uint32_t>(laneMask)));
+						for (uint32_t i{ first }; i < first + count; ++i)
+						{
+							__m128 t{};
+							const __m128 hit{ _mm_and_ps(ToLanes(laneMask), HitTest_Triangle(mesh.triangles, i, rays, max, cullMode, t)) };
+							int triangleMask{ _mm_movemask_ps(hit) };
+							if (triangleMask == 0)
+								continue;
+
+							leafHitMask |= triangleMask;
+							if (!anyHit)
+								max = Select(hit, t, max);
+
+							for (int lanes{ triangleMask }; pTriangleIndices && lanes != 0; lanes &= lanes - 1)
+							{
+								pTriangleIndices[std::countr_zero(static_cast<uint32_t>(lanes))] = i;
+							}
+
+							//Occluded rays skip the rest of the leaf
+							if (anyHit)
+							{
+								laneMask &= ~triangleMask;
+								if (laneMask == 0)
+									break;
+							}
+						}
+					}
+
+					hitMask |= leafHitMask;
+					return anyHit ? leafHitMask : 0;
+				});
+			return hitMask;
+		}
+
+		//Component of the rays moved by transform, x y z are the lanes of the points or directions
+		inline __m128 TransformComponent(const Matrix& transform, int component, __m128 x, __m128 y, __m128 z, bool isPoint)
+		{
+			__m128 result{ _mm_mul_ps(x, _mm_set1_ps(transform[0][component])) };
+			result = _mm_add_ps(result, _mm_mul_ps(y, _mm_set1_ps(transform[1][component])));
+			result = _mm_add_ps(result, _mm_mul_ps(z, _mm_set1_ps(transform[2][component])));
+			return isPoint ? _mm_add_ps(result, _mm_set1_ps(transform[3][component])) : result;
+		}
+
+		/**
+		 * \brief HitTest_TriangleMesh of the shared mesh of an instance: the rays are moved into object space in the
+		 * registers, directions unnormalized so max stays valid. Rays that point into different octants there (the
+		 * transform rotated them across an axis) are traced one by one.
+		 * \param instance instance to test, mesh is the instanced mesh it places
+		 * \param rays packet registers in world space
+		 * \param cullMode instance.GetCullMode of the mesh's cull mode, already flipped for shadow rays
+		 * \return rays whose closest hit is now on this instance, or that hit it at all for any hit tests
+		 */
+		inline int HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const TriangleMesh& mesh, const PacketRegisters& rays, int activeMask,
+			TriangleCullMode cullMode, bool anyHit, __m128& max, uint32_t* pTriangleIndices)
+		{
+			const Matrix& toObject{ instance.inverseTransform };
+
+			PacketRegisters objectRays{ rays };
+			objectRays.originX = TransformComponent(toObject, 0, rays.originX, rays.originY, rays.originZ, true);
+			objectRays.originY = TransformComponent(toObject, 1, rays.originX, rays.originY, rays.originZ, true);
+			objectRays.originZ = TransformComponent(toObject, 2, rays.originX, rays.originY, rays.originZ, true);
+			objectRays.directionX = TransformComponent(toObject, 0, rays.directionX, rays.directionY, rays.directionZ, false);
+			objectRays.directionY = TransformComponent(toObject, 1, rays.directionX, rays.directionY, rays.directionZ, false);
+			objectRays.directionZ = TransformComponent(toObject, 2, rays.directionX, rays.directionY, rays.directionZ, false);
+			objectRays.invDirectionX = _mm_div_ps(_mm_set1_ps(1.f), objectRays.directionX);
+			objectRays.invDirectionY = _mm_div_ps(_mm_set1_ps(1.f), objectRays.directionY);
+			objectRays.invDirectionZ = _mm_div_ps(_mm_set1_ps(1.f), objectRays.directionZ);
+
+			//The single ray kernels read the rays from a packet
+			RayPacket objectPacket{};
+			_mm_store_ps(objectPacket.originX, objectRays.originX);
+			_mm_store_ps(objectPacket.originY, objectRays.originY);
+			_mm_store_ps(objectPacket.originZ, objectRays.originZ);
+			_mm_store_ps(objectPacket.directionX, objectRays.directionX);
+			_mm_store_ps(objectPacket.directionY, objectRays.directionY);
+			_mm_store_ps(objectPacket.directionZ, objectRays.directionZ);
+			objectPacket.min = _mm_cvtss_f32(rays.min);
+
+			const auto isSameSign{ [](__m128 value)
+				{
+					const int signs{ _mm_movemask_ps(value) };
+					return signs == 0 || signs == RayPacket::FullMask;
+				} };
+			if (isSameSign(objectRays.directionX) && isSameSign(objectRays.directionY) && isSameSign(objectRays.directionZ))
+				return HitTest_TriangleMesh(mesh, objectPacket, objectRays, activeMask, cullMode, anyHit, max, pTriangleIndices);
+
+			int hitMask{ 0 };
+			alignas(16) float laneMax[RayPacket::Size];
+			_mm_store_ps(laneMax, max);
+
+			for (int lanes{ activeMask }; lanes != 0; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(static_cast<uint32_t>(lanes)) };
+				Ray ray{ objectPacket.GetRay(lane) };
+				ray.max = laneMax[lane];
+
+				uint32_t closestIndex{ UINT32_MAX };
+				GeometryUtils::TraverseBVH(mesh.bvh, ray, [&](uint32_t first, uint32_t count)
+					{
+						const uint32_t hitIndex{ Simd::IntersectTriangles(mesh.triangles, first, count, ray, cullMode, anyHit) };
+						if (hitIndex == UINT32_MAX)
+							return false;
+
+						closestIndex = hitIndex;
+						return anyHit;
+					});
+				if (closestIndex == UINT32_MAX)
+					continue;
+
+				hitMask |= 1 << lane;
+				if (pTriangleIndices)
+					pTriangleIndices[lane] = closestIndex;
+				if (!anyHit)
+					laneMax[lane] = ray.max;
+			}
+
+			if (!anyHit)
+				max = _mm_load_ps(laneMax);
+			return hitMask;
+		}
+	}
+#endif
+}
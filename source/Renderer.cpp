@@ -5,210 +5,632 @@
 //Project includes
 #include "Renderer.h"
 
-#include <thread>
+#include <algorithm>
 #include <iostream>
 
 #include "Math.h"
 #include "Matrix.h"
 #include "Material.h"
+#include "RayPacket.h"
 #include "Scene.h"
+#include "Simd.h"
+#include "Statistics.h"
 #include "Utils.h"
 
-#include <future>
-#include <ppl.h>
-
 using namespace dae;
-//#define ASYNC
-#define PARALLEL_FOR
 
+#if DAE_ENABLE_STATISTICS
+namespace
+{
+	//Blue -> cyan -> green -> yellow -> red over [0, 1], white above
+	ColorRGB GetHeatmapColor(float value)
+	{
+		if (value > 1.f)
+			return colors::White;
+
+		const float scaled{ std::max(value, 0.f) * 4.f };
+		if (scaled < 1.f)
+			return { 0.f, scaled, 1.f };
+		if (scaled < 2.f)
+			return { 0.f, 1.f, 2.f - scaled };
+		if (scaled < 3.f)
+			return { scaled - 2.f, 1.f, 0.f };
+		return { 1.f, 4.f - scaled, 0.f };
+	}
+}
+#endif
+
+namespace
+{
+	//Per thread memory of the staged tile kernel, grows to the largest tile once
+	struct TileScratch
+	{
+		std::vector<HitRecord> closestHits{}; //Per tile pixel, row major
+		std::vector<Vector3> viewDirections{};
+		std::vector<ColorRGB> colors{};
+		std::vector<uint32_t> hitPixels{}; //Tile pixels whose primary ray hit, in the order they were traced
+		std::vector<Ray> shadowRays{}; //Per hit pixel, toward the light being shaded
+		std::vector<uint8_t> isOccluded{}; //Per hit pixel
+		//Hits the light being shaded reaches (index into hitPixels), gathered for MaterialTable's batched Shade
+		std::vector<uint32_t> litHits{};
+		std::vector<HitRecord> litHitRecords{};
+		std::vector<Vector3> litLightDirections{};
+		std::vector<Vector3> litViewDirections{};
+		std::vector<ColorRGB> litColors{};
+		std::vector<OccluderCache> occluderCaches{}; //Per light, kept from tile to tile
+	};
+
+	thread_local TileScratch g_TileScratch{};
+
+	//Ray from just above the hit point to the light, max is the distance to the light
+	Ray GetShadowRay(const Light& light, const HitRecord& closestHit)
+	{
+		Ray originToLight{};
+		originToLight.origin = closestHit.origin + closestHit.normal * 0.001f;
+		originToLight.direction = LightUtils::GetDirectionToLight(light, originToLight.origin);
+		originToLight.min = 0.001f;
+		originToLight.max = originToLight.direction.Magnitude();
+		originToLight.direction.Normalize();
+		return originToLight;
+	}
+
+	//Adds the term of a light that reaches the hit point, resolved at compile time so every kernel only contains its own
+	template<Renderer::LightingMode Mode>
+	void AddLighting(ColorRGB& finalColor, const Light& light, const HitRecord& closestHit, const Vector3& viewDirection, const Ray& originToLight, const MaterialTable& materials)
+	{
+		const float observedArea{ Vector3::Dot(closestHit.normal,originToLight.direction) };
+
+		if constexpr (Mode == Renderer::LightingMode::ObservedArea)
+		{
+			if (observedArea < 0) return;
+			finalColor += ColorRGB{ observedArea, observedArea, observedArea };
+		}
+		else if constexpr (Mode == Renderer::LightingMode::Radiance)
+		{
+			finalColor += LightUtils::GetRadiance(light, originToLight.origin);
+		}
+		else if constexpr (Mode == Renderer::LightingMode::BRDF)
+		{
+			//if (observedArea < 0) return;
+			finalColor += materials.Shade(closestHit, originToLight.direction, -viewDirection);
+		}
+		else if constexpr (Mode == Renderer::LightingMode::Combined)
+		{
+			if (observedArea < 0) return;
+			finalColor += LightUtils::GetRadiance(light, originToLight.origin)
+				* materials.Shade(closestHit, originToLight.direction, -viewDirection)
+				* observedArea;
+		}
+	}
 
-Renderer::Renderer(SDL_Window * pWindow) :
+	//AddLighting of the BRDF modes for every hit of the tile the light reaches, with the materials shaded as one batch
+	//grouped by material type instead of switching on the type per hit
+	template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+	void ShadeLitHits(TileScratch& scratch, uint32_t hitCount, const Light& light, const MaterialTable& materials)
+	{
+		scratch.litHits.clear();
+		scratch.litHitRecords.clear();
+		scratch.litLightDirections.clear();
+		scratch.litViewDirections.clear();
+		for (uint32_t i{}; i < hitCount; ++i)
+		{
+			if (ShadowsEnabled && scratch.isOccluded[i])
+				continue;
+
+			const uint32_t pixel{ scratch.hitPixels[i] };
+			const HitRecord& closestHit{ scratch.closestHits[pixel] };
+			if (Mode == Renderer::LightingMode::Combined && Vector3::Dot(closestHit.normal, scratch.shadowRays[i].direction) < 0)
+				continue;
+
+			scratch.litHits.push_back(i);
+			scratch.litHitRecords.push_back(closestHit);
+			scratch.litLightDirections.push_back(scratch.shadowRays[i].direction);
+			scratch.litViewDirections.push_back(-scratch.viewDirections[pixel]);
+		}
+
+		const uint32_t litCount{ static_cast<uint32_t>(scratch.litHits.size()) };
+		scratch.litColors.resize(litCount);
+		materials.Shade(scratch.litHitRecords.data(), scratch.litLightDirections.data(), scratch.litViewDirections.data(), litCount, scratch.litColors.data());
+
+		for (uint32_t lit{}; lit < litCount; ++lit)
+		{
+			const uint32_t i{ scratch.litHits[lit] };
+			ColorRGB& finalColor{ scratch.colors[scratch.hitPixels[i]] };
+			if constexpr (Mode == Renderer::LightingMode::BRDF)
+				finalColor += scratch.litColors[lit];
+			else
+			{
+				const Ray& originToLight{ scratch.shadowRays[i] };
+				const float observedArea{ Vector3::Dot(scratch.litHitRecords[lit].normal, originToLight.direction) };
+				finalColor += LightUtils::GetRadiance(light, originToLight.origin) * scratch.litColors[lit] * observedArea;
+			}
+		}
+	}
+}
+
+Renderer::Renderer(SDL_Window * pWindow, uint32_t threadCount) :
 	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	m_ThreadPool(threadCount)
 {
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	InitializeBuffer();
 }
 
-void Renderer::Render(Scene* pScene) const
+Renderer::Renderer(uint32_t width, uint32_t height, uint32_t threadCount) :
+	m_Width(static_cast<int>(width)),
+	m_Height(static_cast<int>(height)),
+	m_ThreadPool(threadCount)
+{
+	InitializeBuffer();
+}
+
+void Renderer::InitializeBuffer()
+{
+	m_FrameBuffer.Resize(m_Width, m_Height);
+	m_pBufferPixels = m_FrameBuffer.GetPixels();
+	m_BufferPitch = m_FrameBuffer.GetPitch();
+
+	//The direction table depends on the resolution, rebuild it with the next frame
+	m_CameraDirectionsFov = -1.f;
+
+	UpdateTiles();
+}
+
+void Renderer::UpdateCameraDirections(float fov, float aspectRatio)
+{
+	const size_t pixelCount{ size_t(m_Width) * m_Height };
+	m_CameraDirectionsX.resize(pixelCount);
+	m_CameraDirectionsY.resize(pixelCount);
+	m_CameraDirectionsZ.resize(pixelCount);
+
+	m_ThreadPool.ParallelFor(static_cast<uint32_t>(m_Height), 16, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t py{ begin }; py < end; ++py)
+			{
+				for (uint32_t px{}; px < static_cast<uint32_t>(m_Width); ++px)
+				{
+					Vector3 rayDirection{};
+
+					float pxc{ float(px) + 0.5f };
+					rayDirection.x = (((2 * pxc) / float(m_Width)) - 1) * aspectRatio * fov;
+
+					float pyc{ float(py) + 0.5f };
+					rayDirection.y = ((1 - ((2 * pyc) / float(m_Height))) * fov);
+
+					rayDirection.z = 1;
+
+					rayDirection.Normalize();
+
+					const size_t pixelIndex{ px + size_t(py) * m_Width };
+					m_CameraDirectionsX[pixelIndex] = rayDirection.x;
+					m_CameraDirectionsY[pixelIndex] = rayDirection.y;
+					m_CameraDirectionsZ[pixelIndex] = rayDirection.z;
+				}
+			}
+		});
+
+	m_CameraDirectionsFov = fov;
+}
+
+void Renderer::Render(Scene* pScene)
 {
 	Camera& camera = pScene->GetCamera();
 	camera.CalculateCameraToWorld();
 
 	float aspectRatio{ float(m_Width) / float(m_Height) };
 
-	float fov{  tan(TO_RADIANS * camera.fovAngle / 2.f) };
+	float fov{ std::tan(TO_RADIANS * camera.fovAngle / 2.f) };
 
 	auto& materials = pScene->GetMaterials();
 	auto& lights = pScene->GetLights();
 
-	const uint32_t numPixels = m_Width * m_Height;
+	if (fov != m_CameraDirectionsFov)
+		UpdateCameraDirections(fov, aspectRatio);
+
+	//Chosen once per frame, the kernels have the lighting mode and shadow test compiled in
+	const TileFunction renderTile{ GetTileFunction() };
+
+	//A tile per chunk, every thread starts on its own run of Z-ordered tiles so
+	//neighbouring tiles (and the BVH nodes their rays touch) stay on the same core
+	m_ThreadPool.ParallelFor(static_cast<uint32_t>(m_TileOrder.size()), 1,
+		[&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i{ begin }; i < end; ++i)
+			{
+				(this->*renderTile)(pScene, m_TileOrder[i], camera, lights, materials);
+			}
+		});
+
+	//Every thread is idle again, merge their counters into the frame's statistics
+	m_Statistics = Statistics::CollectAndReset();
+
+	//@END
+	if (m_pWindow)
+		Present();
+}
+
+void Renderer::Present() const
+{
+	//Fetched every frame, SDL invalidates the surface when the window changes
+	SDL_Surface* pSurface{ SDL_GetWindowSurface(m_pWindow) };
+	if (!pSurface)
+		return;
+
+	//Converts to whatever format the window uses, a plain copy for the usual ARGB8888/RGB888 surfaces
+	SDL_ConvertPixels(m_Width, m_Height,
+		SDL_PIXELFORMAT_ARGB8888, m_pBufferPixels, static_cast<int>(m_BufferPitch * sizeof(uint32_t)),
+		pSurface->format->format, pSurface->pixels, pSurface->pitch);
 
-#if defined(ASYNC)
-	//async logic
-	const uint32_t numCores = std::thread::hardware_concurrency();
-	std::vector<std::future<void>> async_futures{};
+	SDL_UpdateWindowSurface(m_pWindow);
+}
 
-	const uint32_t numPixelPerTask = numPixel / numCores;
-	uint32_t numUnassignedPixels = numPixel % numCores;
-	uint32_t currentPixelIndex{ 0 };
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void Renderer::RenderTile(Scene* pScene, uint32_t tileIndex, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const
+{
+	const uint32_t startX{ (tileIndex % m_TileCountX) * m_TileSize };
+	const uint32_t startY{ (tileIndex / m_TileCountX) * m_TileSize };
+	const uint32_t endX{ std::min(startX + m_TileSize, static_cast<uint32_t>(m_Width)) };
+	const uint32_t endY{ std::min(startY + m_TileSize, static_cast<uint32_t>(m_Height)) };
 
-	for (uint32_t coreId{}; coreId < numCores; ++coreId)
+	//The heatmaps show the work of a single pixel, which batches cannot split over their pixels: trace pixel by pixel
+	if constexpr (Mode == LightingMode::HeatmapNodes || Mode == LightingMode::HeatmapTests)
 	{
-		uint32_t taskSize{ numPixelPerTask };
-		if (numUnassignedPixels > 0)
+		constexpr uint32_t runLength{ 64 };
+		float directionsX[runLength];
+		float directionsY[runLength];
+		float directionsZ[runLength];
+
+		for (uint32_t py{ startY }; py < endY; ++py)
 		{
-			++taskSize;
-			--numUnassignedPixels;
-		}
+			for (uint32_t runX{ startX }; runX < endX; runX += runLength)
+			{
+				const uint32_t count{ std::min(runLength, endX - runX) };
+				const size_t first{ runX + size_t(py) * m_Width };
+				Simd::TransformDirections(camera.cameraToWorld, &m_CameraDirectionsX[first], &m_CameraDirectionsY[first], &m_CameraDirectionsZ[first],
+					count, directionsX, directionsY, directionsZ);
 
-		async_futures.push_back(
-			std::async(std::launch::async, [=,this]
+				for (uint32_t i{}; i < count; ++i)
 				{
+					RenderPixel<Mode, ShadowsEnabled>(pScene, runX + i, py, { directionsX[i], directionsY[i], directionsZ[i] }, camera, lights, materials);
+				}
+			}
+		}
+	}
+	else
+	{
+		//Tile in stages: all primary rays, then per light all shadow rays of the tile as one batch and
+		//the shading of the pixels that see the light, finally the colors to the frame buffer
+		const uint32_t tileWidth{ endX - startX };
+		const uint32_t pixelCount{ tileWidth * (endY - startY) };
 
-					const uint32_t pixelIndexEnd = currentPixelIndex + taskSize;
-					for (uint32_t pixelIndex{ currentPixelIndex }; pixelIndex < pixelIndexEnd; ++pixelIndex)
-					{
-						RenderPixel(pScene, pixelIndex, fov, aspectRatio, camera, lights, materials);
-					}
-				})
-		);
+		TileScratch& scratch{ g_TileScratch };
+		scratch.closestHits.assign(pixelCount, HitRecord{});
+		scratch.viewDirections.resize(pixelCount);
+		scratch.colors.assign(pixelCount, ColorRGB{});
+		scratch.hitPixels.clear();
 
-		currentPixelIndex += taskSize;
-	}
+		TracePrimaryRays(pScene, startX, startY, endX, endY, camera, scratch.closestHits.data(), scratch.viewDirections.data(), scratch.hitPixels);
 
-	//wait
-	for (const std::future<void>& f : async_futures)
-	{
-		f.wait();
-	}
-	
-#elif defined(PARALLEL_FOR)
+		const uint32_t hitCount{ static_cast<uint32_t>(scratch.hitPixels.size()) };
+		scratch.shadowRays.resize(hitCount);
+		scratch.isOccluded.resize(hitCount);
+		scratch.occluderCaches.resize(lights.size());
 
-	Concurrency::parallel_for(0u, numPixels,
-		[=, this](int i)
+		for (size_t lightIndex{}; lightIndex < lights.size(); ++lightIndex)
 		{
-			RenderPixel(pScene, i, fov, aspectRatio, camera, lights, materials);
-		});
-
-#else
+			const Light& light{ lights[lightIndex] };
+			for (uint32_t i{}; i < hitCount; ++i)
+			{
+				scratch.shadowRays[i] = GetShadowRay(light, scratch.closestHits[scratch.hitPixels[i]]);
+			}
 
-	for (uint32_t i{}; i < numPixel; ++i)
-	{
-		RenderPixel(pScene, i, fov, aspectRatio, camera, lights, materials);
-	}
+			if constexpr (ShadowsEnabled)
+				TraceShadowRays(pScene, scratch.shadowRays.data(), hitCount, scratch.isOccluded.data(), scratch.occluderCaches[lightIndex]);
 
-#endif
+			if constexpr (Mode == LightingMode::BRDF || Mode == LightingMode::Combined)
+				ShadeLitHits<Mode, ShadowsEnabled>(scratch, hitCount, light, materials);
+			else
+			{
+				for (uint32_t i{}; i < hitCount; ++i)
+				{
+					if (ShadowsEnabled && scratch.isOccluded[i])
+						continue;
 
-	
+					const uint32_t pixel{ scratch.hitPixels[i] };
+					AddLighting<Mode>(scratch.colors[pixel], light, scratch.closestHits[pixel], scratch.viewDirections[pixel], scratch.shadowRays[i], materials);
+				}
+			}
+		}
 
-	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+		for (uint32_t pixel{}; pixel < pixelCount; ++pixel)
+		{
+			WritePixel(startX + pixel % tileWidth, startY + pixel / tileWidth, scratch.colors[pixel]);
+		}
+	}
 }
 
-void dae::Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::TracePrimaryRays(Scene* pScene, uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY, const Camera& camera,
+	HitRecord* pClosestHits, Vector3* pViewDirections, std::vector<uint32_t>& hitPixels) const
 {
-	Vector3 rayDirection{};
+	const uint32_t tileWidth{ endX - startX };
+	const uint32_t rowStep{ m_PacketTracingEnabled ? 2u : 1u };
 
-	const int px = pixelIndex % m_Width;
-	const int py = pixelIndex / m_Width;
+	//World space directions of a run of pixels (in up to two rows), rotated from the camera space table in one SIMD pass
+	constexpr uint32_t runLength{ 64 };
+	float directionsX[2][runLength];
+	float directionsY[2][runLength];
+	float directionsZ[2][runLength];
 
+	for (uint32_t py{ startY }; py < endY; py += rowStep)
+	{
+		const uint32_t rowCount{ std::min(rowStep, endY - py) };
+		for (uint32_t runX{ startX }; runX < endX; runX += runLength)
+		{
+			const uint32_t count{ std::min(runLength, endX - runX) };
+			for (uint32_t row{}; row < rowCount; ++row)
+			{
+				const size_t first{ runX + size_t(py + row) * m_Width };
+				Simd::TransformDirections(camera.cameraToWorld, &m_CameraDirectionsX[first], &m_CameraDirectionsY[first], &m_CameraDirectionsZ[first],
+					count, directionsX[row], directionsY[row], directionsZ[row]);
+			}
 
-	float pxc{ float(px) + 0.5f };
-	rayDirection.x = (((2 * pxc) / float(m_Width)) - 1) * aspectRatio * fov;
+			//2x2 quads as packets, a last odd row or column falls back to single rays.
+			//Hit pixels are listed in this order, so neighbouring entries also make coherent shadow packets.
+			uint32_t i{};
+			if (rowCount == 2)
+			{
+				for (; i + 1 < count; i += 2)
+				{
+					RayPacket packet{};
+					uint32_t pixels[RayPacket::Size]{};
+					for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
+					{
+						const uint32_t row{ lane / 2 };
+						const uint32_t column{ i + lane % 2 };
+						pixels[lane] = (runX + column - startX) + (py + row - startY) * tileWidth;
+						pViewDirections[pixels[lane]] = { directionsX[row][column], directionsY[row][column], directionsZ[row][column] };
+						packet.SetRay(lane, { camera.origin, pViewDirections[pixels[lane]] });
+					}
 
-	float pyc{ float(py) + 0.5f };
-	rayDirection.y = ((1 - ((2 * pyc) / float(m_Height))) * fov);
+					HitRecord closestHits[RayPacket::Size]{};
+					pScene->GetClosestHits(packet, closestHits);
+					DAE_STATISTICS_ADD(primaryRays, RayPacket::Size);
 
+					for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
+					{
+						pClosestHits[pixels[lane]] = closestHits[lane];
+						if (closestHits[lane].didHit)
+							hitPixels.push_back(pixels[lane]);
+					}
+				}
+			}
+
+			for (uint32_t row{}; row < rowCount; ++row)
+			{
+				for (uint32_t column{ i }; column < count; ++column)
+				{
+					const uint32_t pixel{ (runX + column - startX) + (py + row - startY) * tileWidth };
+					pViewDirections[pixel] = { directionsX[row][column], directionsY[row][column], directionsZ[row][column] };
+
+					pScene->GetClosestHit({ camera.origin, pViewDirections[pixel] }, pClosestHits[pixel]);
+					DAE_STATISTICS_INCREMENT(primaryRays);
+					if (pClosestHits[pixel].didHit)
+						hitPixels.push_back(pixel);
+				}
+			}
+		}
+	}
 
-	rayDirection.z = 1;
+	DAE_STATISTICS_ADD(primaryHits, hitPixels.size());
+}
 
+void Renderer::TraceShadowRays(Scene* pScene, const Ray* pRays, uint32_t count, uint8_t* pIsOccluded, OccluderCache& occluderCache) const
+{
+	DAE_STATISTICS_ADD(shadowRays, count);
 
-	rayDirection.Normalize();
+	if (m_PacketTracingEnabled)
+	{
+		//A last partial packet repeats its last ray, the extra lanes are ignored
+		for (uint32_t first{}; first < count; first += RayPacket::Size)
+		{
+			RayPacket packet{};
+			packet.min = pRays[first].min;
+			for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
+			{
+				packet.SetRay(lane, pRays[std::min(first + lane, count - 1)]);
+			}
 
+			const int occludedMask{ pScene->DoesHit(packet, &occluderCache) };
+			for (uint32_t lane{}; lane < RayPacket::Size && first + lane < count; ++lane)
+			{
+				pIsOccluded[first + lane] = static_cast<uint8_t>((occludedMask >> lane) & 1);
+			}
+		}
+	}
+	else
+	{
+		for (uint32_t i{}; i < count; ++i)
+		{
+			pIsOccluded[i] = pScene->DoesHit(pRays[i], &occluderCache);
+		}
+	}
 
-	rayDirection = camera.cameraToWorld.TransformVector(rayDirection.Normalized());
-	
-	
+#if DAE_ENABLE_STATISTICS
+	for (uint32_t i{}; i < count; ++i)
+	{
+		DAE_STATISTICS_ADD(shadowHits, pIsOccluded[i]);
+	}
+#endif
+}
 
+template<Renderer::LightingMode Mode, bool ShadowsEnabled>
+void dae::Renderer::RenderPixel(Scene* pScene, uint32_t px, uint32_t py, const Vector3& rayDirection, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const
+{
 	Ray viewRay{ camera.origin, rayDirection };
-	ColorRGB finalColor{};
 	HitRecord closestHit{};
 
-
+#if DAE_ENABLE_STATISTICS
+	//The heatmaps show the work this pixel adds to the thread's counters
+	constexpr bool isHeatmap{ Mode == LightingMode::HeatmapNodes || Mode == LightingMode::HeatmapTests };
+	Statistics::Counters countersBefore{};
+	if constexpr (isHeatmap)
+		countersBefore = Statistics::GetThreadCounters();
+#endif
 
 	pScene->GetClosestHit(viewRay, closestHit);
+	DAE_STATISTICS_INCREMENT(primaryRays);
 
-
+	ColorRGB finalColor{};
 
 	if (closestHit.didHit)
 	{
-		//finalColor = materials[closestHit.materialIndex]->Shade();
+		DAE_STATISTICS_INCREMENT(primaryHits);
+
+		std::vector<OccluderCache>& occluderCaches{ g_TileScratch.occluderCaches };
+		occluderCaches.resize(lights.size());
 
-		for (int i{}; i < pScene->GetLights().size(); ++i)
+		for (size_t lightIndex{}; lightIndex < lights.size(); ++lightIndex)
 		{
-			Ray originToLight{};
+			const Light& light{ lights[lightIndex] };
+			const Ray originToLight{ GetShadowRay(light, closestHit) };
 
-			Vector3 lightDirection = LightUtils::GetDirectionToLight(pScene->GetLights()[i], closestHit.origin + closestHit.normal * 0.001f);
+			//Only trace the shadow ray when shadows are on
+			if constexpr (ShadowsEnabled)
+			{
+				DAE_STATISTICS_INCREMENT(shadowRays);
+				if (pScene->DoesHit(originToLight, &occluderCaches[lightIndex]))
+				{
+					DAE_STATISTICS_INCREMENT(shadowHits);
+					continue;
+				}
+			}
 
-			originToLight.origin = closestHit.origin + closestHit.normal * 0.001f;
-			originToLight.direction = lightDirection;
-			originToLight.min = 0.001f;
-			originToLight.max = originToLight.direction.Magnitude();
-			originToLight.direction.Normalize();
+			AddLighting<Mode>(finalColor, light, closestHit, viewRay.direction, originToLight, materials);
+		}
+	}
 
+#if DAE_ENABLE_STATISTICS
+	if constexpr (isHeatmap)
+	{
+		const Statistics::Counters& counters{ Statistics::GetThreadCounters() };
+		const uint64_t cost{ Mode == LightingMode::HeatmapNodes
+			? counters.bvhNodesVisited - countersBefore.bvhNodesVisited
+			: (counters.sphereTests + counters.planeTests + counters.triangleTests)
+			- (countersBefore.sphereTests + countersBefore.planeTests + countersBefore.triangleTests) };
 
-			if (pScene->DoesHit(originToLight) && m_ShadowsEnabled) continue;
+		finalColor = GetHeatmapColor(float(cost) / m_HeatmapScale);
+	}
+#endif
 
+	WritePixel(px, py, finalColor);
+}
 
-			const float observedArea{ Vector3::Dot(closestHit.normal,originToLight.direction) };
+void Renderer::WritePixel(uint32_t px, uint32_t py, ColorRGB color) const
+{
+	//Update Color in Buffer
+	color.MaxToOne();
 
-			switch (m_CurrentLightingMode)
-			{
-			case LightingMode::ObservedArea:
-				if (observedArea < 0) continue;
-				finalColor += ColorRGB{ observedArea, observedArea, observedArea };
-				break;
-			case LightingMode::Radiance:
-				finalColor += LightUtils::GetRadiance(pScene->GetLights()[i], originToLight.origin);
-				break;
-			case LightingMode::BRDF:
-				//if (observedArea < 0) continue;
-				finalColor += materials[closestHit.materialIndex]->Shade(closestHit, originToLight.direction, -viewRay.direction);
-				break;
-			case LightingMode::Combined:
-				if (observedArea < 0) continue;
-				finalColor += LightUtils::GetRadiance(pScene->GetLights()[i], originToLight.origin)
-					* materials[closestHit.materialIndex]->Shade(closestHit, originToLight.direction, -viewRay.direction)
-					* observedArea;
-				break;
-			default:
-				break;
-			}
-		}
+	m_pBufferPixels[px + (py * m_BufferPitch)] = FrameBuffer::PackColor(
+		static_cast<uint8_t>(color.r * 255),
+		static_cast<uint8_t>(color.g * 255),
+		static_cast<uint8_t>(color.b * 255));
+}
 
-		/*const float scaled_t{ closestHit.t  / 500.f };
-		finalColor = { scaled_t, scaled_t, scaled_t };*/
-	}
+bool Renderer::SaveBufferToImage(const std::string& path) const
+{
+	return m_FrameBuffer.SaveToBMP(path);
+}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+void Renderer::SetTileSize(uint32_t tileSize)
+{
+	m_TileSize = std::max((tileSize + TileAlignment - 1) / TileAlignment * TileAlignment, TileAlignment);
+	UpdateTiles();
+}
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+void Renderer::UpdateTiles()
+{
+	m_TileCountX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_TileCountY = (m_Height + m_TileSize - 1) / m_TileSize;
+
+	m_TileOrder.resize(m_TileCountX * m_TileCountY);
+	for (uint32_t i{}; i < m_TileOrder.size(); ++i)
+	{
+		m_TileOrder[i] = i;
+	}
 
+	//Z-order over the tile grid, works for non-square and non power of two grids as well
+	std::sort(m_TileOrder.begin(), m_TileOrder.end(), [this](uint32_t a, uint32_t b)
+		{
+			return MortonEncode2D(a % m_TileCountX, a / m_TileCountX) < MortonEncode2D(b % m_TileCountX, b / m_TileCountX);
+		});
 }
 
-bool Renderer::SaveBufferToImage() const
+template<Renderer::LightingMode Mode>
+Renderer::TileFunction Renderer::GetTileFunction(bool shadowsEnabled)
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return shadowsEnabled ? &Renderer::RenderTile<Mode, true> : &Renderer::RenderTile<Mode, false>;
+}
+
+Renderer::TileFunction Renderer::GetTileFunction() const
+{
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::ObservedArea:
+		return GetTileFunction<LightingMode::ObservedArea>(m_ShadowsEnabled);
+	case LightingMode::Radiance:
+		return GetTileFunction<LightingMode::Radiance>(m_ShadowsEnabled);
+	case LightingMode::BRDF:
+		return GetTileFunction<LightingMode::BRDF>(m_ShadowsEnabled);
+	case LightingMode::HeatmapNodes:
+		return GetTileFunction<LightingMode::HeatmapNodes>(m_ShadowsEnabled);
+	case LightingMode::HeatmapTests:
+		return GetTileFunction<LightingMode::HeatmapTests>(m_ShadowsEnabled);
+	case LightingMode::Combined:
+	default:
+		return GetTileFunction<LightingMode::Combined>(m_ShadowsEnabled);
+	}
 }
 
 void Renderer::CycleLightingMode()
 {
-	m_CurrentLightingMode = LightingMode((int(m_CurrentLightingMode) + 1) % 4);
+	const int modeCount{ int(Statistics::IsEnabled() ? LightingMode::HeatmapTests : LightingMode::Combined) + 1 };
+	m_CurrentLightingMode = LightingMode((int(m_CurrentLightingMode) + 1) % modeCount);
+}
+
+void Renderer::PrintLightingMode(std::ostream& output) const
+{
+	const char* pUnit{};
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::ObservedArea:
+		output << "Lighting mode: ObservedArea" << std::endl;
+		return;
+	case LightingMode::Radiance:
+		output << "Lighting mode: Radiance" << std::endl;
+		return;
+	case LightingMode::BRDF:
+		output << "Lighting mode: BRDF" << std::endl;
+		return;
+	case LightingMode::Combined:
+		output << "Lighting mode: Combined" << std::endl;
+		return;
+	case LightingMode::HeatmapNodes:
+		pUnit = "BVH nodes visited";
+		break;
+	case LightingMode::HeatmapTests:
+		pUnit = "intersection tests";
+		break;
+	}
+
+	output << "Lighting mode: heatmap of " << pUnit << " per pixel (primary + shadow rays)" << std::endl;
+	if (!Statistics::IsEnabled())
+	{
+		output << "  Statistics are compiled out, build with DAE_ENABLE_STATISTICS=1 to see the heatmap" << std::endl;
+		return;
+	}
+
+	//Counts at the stops of GetHeatmapColor's ramp
+	output << "  blue 0 | cyan " << m_HeatmapScale * 0.25f << " | green " << m_HeatmapScale * 0.5f
+		<< " | yellow " << m_HeatmapScale * 0.75f << " | red " << m_HeatmapScale << " | white > " << m_HeatmapScale << std::endl;
 }
@@ -1,22 +1,43 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <ostream>
+#include <string>
 #include <vector>
 
+#include "FrameBuffer.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
+
 struct SDL_Window;
-struct SDL_Surface;
 
 namespace dae
 {
 	class Scene;
 	class Camera;
 	class Light;
-	class Material;
+	class MaterialTable;
+	struct ColorRGB;
+	struct HitRecord;
+	struct OccluderCache;
+	struct Ray;
+	struct Vector3;
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
+		/**
+		 * \brief Renderer presenting every frame to the window surface
+		 * \param threadCount render threads including the calling one (0 = hardware concurrency)
+		 */
+		Renderer(SDL_Window* pWindow, uint32_t threadCount = 0);
+
+		/**
+		 * \brief Headless renderer, frames only end up in the frame buffer (and on disk through SaveBufferToImage)
+		 * \param threadCount render threads including the calling one (0 = hardware concurrency)
+		 */
+		Renderer(uint32_t width, uint32_t height, uint32_t threadCount = 0);
 		~Renderer() = default;
 
 		Renderer(const Renderer&) = delete;
@@ -24,15 +45,27 @@ namespace dae
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
+		void Render(Scene* pScene);
 
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
-		bool SaveBufferToImage() const;
+		//Writes the last frame as BMP, returns true on success
+		bool SaveBufferToImage(const std::string& path = "RayTracing_Buffer.bmp") const;
+		const FrameBuffer& GetFrameBuffer() const { return m_FrameBuffer; }
+		uint32_t GetThreadCount() const { return m_ThreadPool.GetThreadCount(); }
+		//The render threads, idle between frames, e.g. for the scene's BVH builds
+		ThreadPool& GetThreadPool() { return m_ThreadPool; }
 
-		void CycleLightingMode();
-		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		//Ray and test counts of the last frame, all zero unless DAE_ENABLE_STATISTICS is set
+		const Statistics::Counters& GetStatistics() const { return m_Statistics; }
 
-	private:
+		/**
+		 * \brief Sets the size of the square screen tiles the threads render, rounded up to a multiple of TileAlignment
+		 * \param tileSize tile width and height in pixels
+		 */
+		void SetTileSize(uint32_t tileSize);
+		uint32_t GetTileSize() const { return m_TileSize; }
+
+		//Tile sizes are a multiple of this so one tile row spans whole 64 byte cache lines of the 32 bit buffer
+		static constexpr uint32_t TileAlignment{ 16 };
 
 		enum class LightingMode
 		{
@@ -40,18 +73,90 @@ namespace dae
 			Radiance, //Incident Radiance
 			BRDF, //Scattering of light
 			Combined, //ObservedArea*Radiance*BRDF
+			HeatmapNodes, //BVH nodes visited per pixel, needs DAE_ENABLE_STATISTICS
+			HeatmapTests, //Sphere, plane and triangle tests per pixel, needs DAE_ENABLE_STATISTICS
 		};
 
+		//Skips the heatmaps when statistics are compiled out
+		void CycleLightingMode();
+		void SetLightingMode(LightingMode lightingMode) { m_CurrentLightingMode = lightingMode; }
+		LightingMode GetLightingMode() const { return m_CurrentLightingMode; }
+		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+
+		//Primary rays of 2x2 pixel quads and the shadow rays of neighbouring hits are traced as packets,
+		//the heatmaps always trace single rays
+		void SetPacketTracing(bool isEnabled) { m_PacketTracingEnabled = isEnabled; }
+		bool IsPacketTracingEnabled() const { return m_PacketTracingEnabled; }
+		void TogglePacketTracing() { m_PacketTracingEnabled = !m_PacketTracingEnabled; }
+
+		/**
+		 * \brief Sets the per pixel count the heatmaps show as red, lower counts go through yellow, green and cyan to blue
+		 * and higher counts are white. Primary and shadow rays of the pixel both count.
+		 * \param scale count mapped to the top of the color ramp, at least 1
+		 */
+		void SetHeatmapScale(float scale) { m_HeatmapScale = std::max(scale, 1.f); }
+		float GetHeatmapScale() const { return m_HeatmapScale; }
+
+		//Name of the current lighting mode, followed by the color legend when it is a heatmap
+		void PrintLightingMode(std::ostream& output) const;
+
+	private:
+
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+		bool m_PacketTracingEnabled{ true };
+		float m_HeatmapScale{ 64.f };
+
+		Statistics::Counters m_Statistics{};
 
 
-		SDL_Window* m_pWindow{};
+		SDL_Window* m_pWindow{}; //nullptr when headless
 
-		SDL_Surface* m_pBuffer{};
+		FrameBuffer m_FrameBuffer{};
 		uint32_t* m_pBufferPixels{};
+		uint32_t m_BufferPitch{};
 
 		int m_Width{};
 		int m_Height{};
+
+		uint32_t m_TileSize{ 32 };
+		uint32_t m_TileCountX{};
+		uint32_t m_TileCountY{};
+		std::vector<uint32_t> m_TileOrder{}; //Tile indices (ty * m_TileCountX + tx) in Z-order
+
+		//Normalized camera space primary ray direction per pixel (row major, one array per component).
+		//Only depends on the resolution and FOV, every frame merely rotates it into world space.
+		std::vector<float> m_CameraDirectionsX{};
+		std::vector<float> m_CameraDirectionsY{};
+		std::vector<float> m_CameraDirectionsZ{};
+		float m_CameraDirectionsFov{ -1.f }; //tan(fovAngle / 2) the table was built for, negative when it needs a rebuild
+
+		void InitializeBuffer();
+		void UpdateTiles();
+		void UpdateCameraDirections(float fov, float aspectRatio);
+		void Present() const;
+
+		//Pixel kernels specialized per lighting mode and shadow setting, so the per light loop has no mode switch or shadow check
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderTile(Scene* pScene, uint32_t tileIndex, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const;
+		template<LightingMode Mode, bool ShadowsEnabled>
+		void RenderPixel(Scene* pScene, uint32_t px, uint32_t py, const Vector3& rayDirection, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const;
+		void WritePixel(uint32_t px, uint32_t py, ColorRGB color) const;
+
+		//Closest hits and world space view directions of the tile's pixels (row major), the hit pixels are listed in hitPixels
+		void TracePrimaryRays(Scene* pScene, uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY, const Camera& camera,
+			HitRecord* pClosestHits, Vector3* pViewDirections, std::vector<uint32_t>& hitPixels) const;
+
+		//Any hit tests of a batch of shadow rays toward one light that share ray.min, in packets of neighbouring rays when
+		//packet tracing is on. occluderCache is the calling thread's last occluder toward that light.
+		void TraceShadowRays(Scene* pScene, const Ray* pRays, uint32_t count, uint8_t* pIsOccluded, OccluderCache& occluderCache) const;
+
+		using TileFunction = void (Renderer::*)(Scene* pScene, uint32_t tileIndex, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const;
+		TileFunction GetTileFunction() const;
+		template<LightingMode Mode>
+		static TileFunction GetTileFunction(bool shadowsEnabled);
+
+		//Created once with the renderer, reused by every frame
+		ThreadPool m_ThreadPool;
 	};
 }
@@ -1,46 +1,39 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
+#include "RayPacket.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iostream>
 
 namespace dae {
 
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
-	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+	Scene::Scene()
 	{
+		m_Materials.Add(Material_SolidColor({ 1,0,0 }));
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
-	{
-		for(auto& pMaterial : m_Materials)
-		{
-			delete pMaterial;
-			pMaterial = nullptr;
-		}
-
-		m_Materials.clear();
-	}
+	Scene::~Scene() = default;
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
 		//todo W1
+		assert(!m_IsAccelerationStructureDirty && "Acceleration structure not built, call BuildAccelerationStructure()");
+
 		HitRecord testHit{};
 		testHit.t = FLT_MAX;
-		for (int i{}; i < m_SphereGeometries.size(); ++i)
-		{
-			GeometryUtils::HitTest_Sphere(m_SphereGeometries[i], ray, testHit);
-			if (testHit.t < closestHit.t )
-			{
-				closestHit = testHit;
-			}
-		}
-
 
+		//Planes first, their hit already shortens the ray for the BVH traversal
+		DAE_STATISTICS_ADD(planeTests, m_PlaneGeometries.size());
 		for (int i{}; i < m_PlaneGeometries.size(); ++i)
 		{
 			GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray, testHit);
@@ -50,50 +43,627 @@ namespace dae {
 			}
 		}
 
-		for (int i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		Ray traversalRay{ ray };
+		traversalRay.max = std::min(ray.max, closestHit.t);
+
+		GeometryUtils::TraverseBVH(m_TopLevelBVH, traversalRay, [&](uint32_t first, uint32_t count)
+			{
+				//Every leaf starts with its spheres, they sit next to each other in m_Spheres
+				uint32_t i{ first };
+				while (i < first + count && m_TopLevelGeometries[i].type == GeometryType::Sphere)
+				{
+					++i;
+				}
+
+				if (i > first)
+				{
+					const uint32_t sphereIndex{ Simd::IntersectSpheres(m_Spheres, m_TopLevelGeometries[first].index, i - first, traversalRay, false) };
+					if (sphereIndex != UINT32_MAX)
+					{
+						closestHit.didHit = true;
+						closestHit.t = traversalRay.max;
+						closestHit.origin = ray.origin + (closestHit.t * ray.direction);
+						closestHit.normal = (closestHit.origin - m_Spheres.GetOrigin(sphereIndex)).Normalized();
+						closestHit.materialIndex = m_Spheres.materialIndex[sphereIndex];
+					}
+				}
+
+				for (; i < first + count; ++i)
+				{
+					const GeometryReference& geometry{ m_TopLevelGeometries[i] };
+					const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+					if (pPlacement)
+						GeometryUtils::HitTest_TriangleMeshInstance(*pPlacement, GetMesh(geometry), traversalRay, closestHit);
+					else
+						GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[geometry.index], traversalRay, closestHit);
+				}
+
+				traversalRay.max = std::min(traversalRay.max, closestHit.t);
+				return false;
+			});
+		//assert(false && "No Implemented Yet!");
+	}
+
+	void Scene::GetClosestHits(const RayPacket& packet, HitRecord* pClosestHits) const
+	{
+		assert(!m_IsAccelerationStructureDirty && "Acceleration structure not built, call BuildAccelerationStructure()");
+
+#if defined(DAE_SIMD_X86)
+		if (Simd::GetLevel() != Simd::Level::Scalar && packet.IsCoherent())
 		{
-			GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[i], ray, testHit);
-			if (testHit.t < closestHit.t)
+			//Planes ray by ray, their hits already shorten the rays for the traversal
+			alignas(16) float max[RayPacket::Size]{};
+			DAE_STATISTICS_ADD(planeTests, m_PlaneGeometries.size() * RayPacket::Size);
+			for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
 			{
-				closestHit = testHit;
+				const Ray ray{ packet.GetRay(lane) };
+				HitRecord& closestHit{ pClosestHits[lane] };
+
+				HitRecord testHit{};
+				for (const Plane& plane : m_PlaneGeometries)
+				{
+					GeometryUtils::HitTest_Plane(plane, ray, testHit);
+					if (testHit.t < closestHit.t)
+					{
+						closestHit = testHit;
+					}
+				}
+				max[lane] = std::min(ray.max, closestHit.t);
+			}
+
+			const PacketUtils::PacketRegisters rays{ packet };
+			__m128 maxRegister{ _mm_load_ps(max) };
+
+			//What every ray hit last, its hit record is only filled in once the traversal found the closest one
+			int hitMask{ 0 };
+			GeometryType hitTypes[RayPacket::Size]{};
+			uint32_t hitIndices[RayPacket::Size]{};
+			uint32_t triangleIndices[RayPacket::Size]{};
+
+			PacketUtils::TraverseBVH(m_TopLevelBVH, rays, RayPacket::FullMask, maxRegister, [&](uint32_t first, uint32_t count, int laneMask)
+				{
+					//Every leaf starts with its spheres, they sit next to each other in m_Spheres
+					uint32_t i{ first };
+					while (i < first + count && m_TopLevelGeometries[i].type == GeometryType::Sphere)
+					{
+						++i;
+					}
+
+					const uint32_t firstSphere{ i > first ? m_TopLevelGeometries[first].index : 0 };
+					const uint32_t sphereCount{ i - first };
+					if (sphereCount > 0 && !PacketUtils::IsPacketTestCheaper(sphereCount, laneMask, rays.kernelWidth))
+					{
+						alignas(16) float laneMax[RayPacket::Size];
+						_mm_store_ps(laneMax, maxRegister);
+
+						for (int lanes{ laneMask }; lanes != 0; lanes &= lanes - 1)
+						{
+							const int lane{ std::countr_zero(static_cast<uint32_t>(lanes)) };
+							Ray ray{ packet.GetRay(lane) };
+							ray.max = laneMax[lane];
+
+							const uint32_t sphereIndex{ Simd::IntersectSpheres(m_Spheres, firstSphere, sphereCount, ray, false) };
+							if (sphereIndex == UINT32_MAX)
+								continue;
+
+							laneMax[lane] = ray.max;
+							hitMask |= 1 << lane;
+							hitTypes[lane] = GeometryType::Sphere;
+							hitIndices[lane] = sphereIndex;
+						}
+						maxRegister = _mm_load_ps(laneMax);
+					}
+					else if (sphereCount > 0)
+					{
+						DAE_STATISTICS_ADD(sphereTests, sphereCount * std::popcount(static_cast<uint32_t>(laneMask)));
+						for (uint32_t sphereIndex{ firstSphere }; sphereIndex < firstSphere + sphereCount; ++sphereIndex)
+						{
+							__m128 t{};
+							const __m128 hit{ _mm_and_ps(PacketUtils::ToLanes(laneMask), PacketUtils::HitTest_Sphere(m_Spheres, sphereIndex, rays, maxRegister, t)) };
+							int sphereMask{ _mm_movemask_ps(hit) };
+							if (sphereMask == 0)
+								continue;
+
+							maxRegister = PacketUtils::Select(hit, t, maxRegister);
+							hitMask |= sphereMask;
+							while (sphereMask != 0)
+							{
+								const int lane{ std::countr_zero(static_cast<uint32_t>(sphereMask)) };
+								sphereMask &= sphereMask - 1;
+								hitTypes[lane] = GeometryType::Sphere;
+								hitIndices[lane] = sphereIndex;
+							}
+						}
+					}
+
+					for (; i < first + count; ++i)
+					{
+						const GeometryReference& geometry{ m_TopLevelGeometries[i] };
+						const TriangleMesh& mesh{ GetMesh(geometry) };
+						const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+						int meshMask{ pPlacement
+							? PacketUtils::HitTest_TriangleMeshInstance(*pPlacement, mesh, rays, laneMask, pPlacement->GetCullMode(mesh.cullMode), false, maxRegister, triangleIndices)
+							: PacketUtils::HitTest_TriangleMesh(mesh, packet, rays, laneMask, mesh.cullMode, false, maxRegister, triangleIndices) };
+
+						hitMask |= meshMask;
+						while (meshMask != 0)
+						{
+							const int lane{ std::countr_zero(static_cast<uint32_t>(meshMask)) };
+							meshMask &= meshMask - 1;
+							hitTypes[lane] = geometry.type;
+							hitIndices[lane] = geometry.index;
+						}
+					}
+					return 0;
+				});
+
+			_mm_store_ps(max, maxRegister);
+			while (hitMask != 0)
+			{
+				const int lane{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+				hitMask &= hitMask - 1;
+
+				const Ray ray{ packet.GetRay(lane) };
+				HitRecord& closestHit{ pClosestHits[lane] };
+				closestHit.didHit = true;
+				closestHit.t = max[lane];
+				closestHit.origin = ray.origin + (closestHit.t * ray.direction);
+
+				if (hitTypes[lane] == GeometryType::Sphere)
+				{
+					closestHit.normal = (closestHit.origin - m_Spheres.GetOrigin(hitIndices[lane])).Normalized();
+					closestHit.materialIndex = m_Spheres.materialIndex[hitIndices[lane]];
+				}
+				else
+				{
+					const GeometryReference geometry{ hitTypes[lane], hitIndices[lane] };
+					const TriangleMesh& mesh{ GetMesh(geometry) };
+					const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+					const Vector3& normal{ mesh.triangles.normals[triangleIndices[lane]] };
+					closestHit.normal = pPlacement ? pPlacement->TransformNormal(normal) : normal;
+					closestHit.materialIndex = pPlacement ? pPlacement->materialIndex : mesh.materialIndex;
+				}
 			}
+			return;
+		}
+#endif
+
+		for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
+		{
+			GetClosestHit(packet.GetRay(lane), pClosestHits[lane]);
 		}
-		//assert(false && "No Implemented Yet!");
 	}
 
-	bool Scene::DoesHit(const Ray& ray) const
+	bool Scene::DoesHit(const Ray& ray, OccluderCache* pOccluderCache) const
 	{
-
 		//todo W3
 		//assert(false && "No Implemented Yet!");
-		HitRecord testHit{};
-		testHit.t = FLT_MAX;
-		for (int i{}; i < m_SphereGeometries.size(); ++i)
+		assert(!m_IsAccelerationStructureDirty && "Acceleration structure not built, call BuildAccelerationStructure()");
+
+		for (int i{}; i < m_PlaneGeometries.size(); ++i)
 		{
-			if (GeometryUtils::HitTest_Sphere(m_SphereGeometries[i], ray, testHit, true))
+			DAE_STATISTICS_INCREMENT(planeTests);
+			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray))
 			{
 				return true;
 			}
 		}
 
-
-		for (int i{}; i < m_PlaneGeometries.size(); ++i)
+		//The occluder of the previous shadow ray toward this light first, it often blocks this one too
+		if (pOccluderCache && IsOccluderValid(*pOccluderCache))
 		{
-			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray, testHit, true))
+			DAE_STATISTICS_INCREMENT(occluderCacheTests);
+			if (HitTest_Occluder(*pOccluderCache, ray))
 			{
+				DAE_STATISTICS_INCREMENT(occluderCacheHits);
 				return true;
 			}
 		}
 
-		for (int i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		//Any hit is enough, stop the traversal on the first occluder
+		Ray traversalRay{ ray };
+		bool didHit{ false };
+
+		GeometryUtils::TraverseBVH(m_TopLevelBVH, traversalRay, [&](uint32_t first, uint32_t count)
+			{
+				uint32_t i{ first };
+				while (i < first + count && m_TopLevelGeometries[i].type == GeometryType::Sphere)
+				{
+					++i;
+				}
+
+				if (i > first)
+				{
+					const uint32_t sphereIndex{ Simd::IntersectSpheres(m_Spheres, m_TopLevelGeometries[first].index, i - first, traversalRay, true) };
+					if (sphereIndex != UINT32_MAX)
+					{
+						if (pOccluderCache)
+							*pOccluderCache = { OccluderCache::Type::Sphere, sphereIndex };
+						didHit = true;
+						return true;
+					}
+				}
+
+				for (; i < first + count; ++i)
+				{
+					const GeometryReference& geometry{ m_TopLevelGeometries[i] };
+					const bool isInstance{ geometry.type == GeometryType::MeshInstance };
+					const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+
+					uint32_t triangleIndex{};
+					const bool isOccluded{ pPlacement
+						? GeometryUtils::HitTest_TriangleMeshInstance(*pPlacement, GetMesh(geometry), ray, triangleIndex)
+						: GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[geometry.index], ray, triangleIndex) };
+					if (isOccluded)
+					{
+						if (pOccluderCache)
+							*pOccluderCache = { isInstance ? OccluderCache::Type::InstanceTriangle : OccluderCache::Type::Triangle, triangleIndex, geometry.index };
+						didHit = true;
+						return true;
+					}
+				}
+				return false;
+			});
+
+		//An unoccluded ray is usually followed by more of them, drop the occluder instead of testing it for every one
+		if (!didHit && pOccluderCache)
+			pOccluderCache->type = OccluderCache::Type::None;
+
+		return didHit;
+	}
+
+	int Scene::DoesHit(const RayPacket& packet, OccluderCache* pOccluderCache) const
+	{
+		assert(!m_IsAccelerationStructureDirty && "Acceleration structure not built, call BuildAccelerationStructure()");
+
+		int occludedMask{ 0 };
+
+#if defined(DAE_SIMD_X86)
+		if (Simd::GetLevel() != Simd::Level::Scalar && packet.IsCoherent())
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[i], ray, testHit))
+			for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
 			{
-				return true;
+				const Ray ray{ packet.GetRay(lane) };
+				for (const Plane& plane : m_PlaneGeometries)
+				{
+					DAE_STATISTICS_INCREMENT(planeTests);
+					if (GeometryUtils::HitTest_Plane(plane, ray))
+					{
+						occludedMask |= 1 << lane;
+						break;
+					}
+				}
+			}
+
+			if (pOccluderCache && IsOccluderValid(*pOccluderCache))
+			{
+				for (int lanes{ RayPacket::FullMask & ~occludedMask }; lanes != 0; lanes &= lanes - 1)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(lanes)) };
+					DAE_STATISTICS_INCREMENT(occluderCacheTests);
+					if (HitTest_Occluder(*pOccluderCache, packet.GetRay(lane)))
+					{
+						DAE_STATISTICS_INCREMENT(occluderCacheHits);
+						occludedMask |= 1 << lane;
+					}
+				}
 			}
+
+			if (occludedMask == RayPacket::FullMask)
+				return occludedMask;
+
+			//Any hit is enough, a ray drops out of the traversal with its first occluder
+			const PacketUtils::PacketRegisters rays{ packet };
+			__m128 maxRegister{ _mm_load_ps(packet.max) };
+
+			PacketUtils::TraverseBVH(m_TopLevelBVH, rays, RayPacket::FullMask & ~occludedMask, maxRegister, [&](uint32_t first, uint32_t count, int laneMask)
+				{
+					int leafMask{ 0 };
+
+					uint32_t i{ first };
+					while (i < first + count && m_TopLevelGeometries[i].type == GeometryType::Sphere)
+					{
+						++i;
+					}
+
+					const uint32_t firstSphere{ i > first ? m_TopLevelGeometries[first].index : 0 };
+					const uint32_t sphereCount{ i - first };
+					if (sphereCount > 0 && !PacketUtils::IsPacketTestCheaper(sphereCount, laneMask, rays.kernelWidth))
+					{
+						for (int lanes{ laneMask }; lanes != 0; lanes &= lanes - 1)
+						{
+							const int lane{ std::countr_zero(static_cast<uint32_t>(lanes)) };
+							Ray ray{ packet.GetRay(lane) };
+							const uint32_t sphereIndex{ Simd::IntersectSpheres(m_Spheres, firstSphere, sphereCount, ray, true) };
+							if (sphereIndex == UINT32_MAX)
+								continue;
+
+							leafMask |= 1 << lane;
+							if (pOccluderCache)
+								*pOccluderCache = { OccluderCache::Type::Sphere, sphereIndex };
+						}
+					}
+					else
+					{
+						for (uint32_t sphereIndex{ firstSphere }; sphereIndex < firstSphere + sphereCount && (laneMask & ~leafMask) != 0; ++sphereIndex)
+						{
+							DAE_STATISTICS_ADD(sphereTests, std::popcount(static_cast<uint32_t>(laneMask & ~leafMask)));
+
+							__m128 t{};
+							const __m128 hit{ _mm_and_ps(PacketUtils::ToLanes(laneMask & ~leafMask), PacketUtils::HitTest_Sphere(m_Spheres, sphereIndex, rays, maxRegister, t)) };
+							const int sphereMask{ _mm_movemask_ps(hit) };
+							if (sphereMask == 0)
+								continue;
+
+							leafMask |= sphereMask;
+							if (pOccluderCache)
+								*pOccluderCache = { OccluderCache::Type::Sphere, sphereIndex };
+						}
+					}
+					laneMask &= ~leafMask;
+
+					for (; i < first + count && laneMask != 0; ++i)
+					{
+						const GeometryReference& geometry{ m_TopLevelGeometries[i] };
+						const bool isInstance{ geometry.type == GeometryType::MeshInstance };
+
+						//Flipped cull mode for shadows, like the single ray test
+						const TriangleMesh& mesh{ GetMesh(geometry) };
+						const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+						TriangleCullMode cullMode{ pPlacement ? pPlacement->GetCullMode(mesh.cullMode) : mesh.cullMode };
+						if (cullMode != TriangleCullMode::NoCulling)
+							cullMode = TriangleCullMode((int(cullMode) + 1) % 2);
+
+						uint32_t triangleIndices[RayPacket::Size]{};
+						const int meshMask{ pPlacement
+							? PacketUtils::HitTest_TriangleMeshInstance(*pPlacement, mesh, rays, laneMask, cullMode, true, maxRegister, triangleIndices)
+							: PacketUtils::HitTest_TriangleMesh(mesh, packet, rays, laneMask, cullMode, true, maxRegister, triangleIndices) };
+						if (meshMask == 0)
+							continue;
+
+						leafMask |= meshMask;
+						laneMask &= ~meshMask;
+						if (pOccluderCache)
+						{
+							*pOccluderCache = { isInstance ? OccluderCache::Type::InstanceTriangle : OccluderCache::Type::Triangle,
+								triangleIndices[std::countr_zero(static_cast<uint32_t>(meshMask))], geometry.index };
+						}
+					}
+
+					occludedMask |= leafMask;
+					return leafMask;
+				});
+
+			if (occludedMask == 0 && pOccluderCache)
+				pOccluderCache->type = OccluderCache::Type::None;
+
+			return occludedMask;
+		}
+#endif
+
+		for (uint32_t lane{}; lane < RayPacket::Size; ++lane)
+		{
+			if (DoesHit(packet.GetRay(lane), pOccluderCache))
+				occludedMask |= 1 << lane;
+		}
+		return occludedMask;
+	}
+
+	bool Scene::IsOccluderValid(const OccluderCache& occluderCache) const
+	{
+		switch (occluderCache.type)
+		{
+		case OccluderCache::Type::Sphere:
+			return occluderCache.index < m_SphereGeometries.size();
+		case OccluderCache::Type::Triangle:
+			return occluderCache.meshIndex < m_TriangleMeshGeometries.size()
+				&& occluderCache.index < m_TriangleMeshGeometries[occluderCache.meshIndex].triangles.normals.size();
+		case OccluderCache::Type::InstanceTriangle:
+			return occluderCache.meshIndex < m_TriangleMeshInstances.size()
+				&& occluderCache.index < GetInstancedMesh(occluderCache.meshIndex).triangles.normals.size();
+		default:
+			return false;
+		}
+	}
+
+	bool Scene::HitTest_Occluder(const OccluderCache& occluderCache, const Ray& ray) const
+	{
+		float t{};
+		if (occluderCache.type == OccluderCache::Type::Sphere)
+		{
+			DAE_STATISTICS_INCREMENT(sphereTests);
+			return GeometryUtils::HitTest_Sphere(m_Spheres, occluderCache.index, ray, t);
+		}
+
+		//Flipped cull mode for shadows, like the mesh test
+		const GeometryReference geometry{ occluderCache.type == OccluderCache::Type::InstanceTriangle ? GeometryType::MeshInstance : GeometryType::TriangleMesh, occluderCache.meshIndex };
+		const TriangleMesh& mesh{ GetMesh(geometry) };
+		const TriangleMeshInstance* pPlacement{ GetPlacement(geometry) };
+		TriangleCullMode cullMode{ pPlacement ? pPlacement->GetCullMode(mesh.cullMode) : mesh.cullMode };
+		if (cullMode != TriangleCullMode::NoCulling)
+			cullMode = TriangleCullMode((int(cullMode) + 1) % 2);
+
+		DAE_STATISTICS_INCREMENT(triangleTests);
+		if (pPlacement)
+			return GeometryUtils::HitTest_Triangle(mesh.triangles, occluderCache.index, pPlacement->ToObjectSpace(ray), cullMode, t);
+		return GeometryUtils::HitTest_Triangle(mesh.triangles, occluderCache.index, ray, cullMode, t);
+	}
+
+	void Scene::GetGeometryBounds(std::vector<AABB>& geometryBounds, std::vector<GeometryReference>& geometries) const
+	{
+		geometryBounds.clear();
+		geometries.clear();
+		const size_t geometryCount{ m_SphereGeometries.size() + m_TriangleMeshGeometries.size() + m_TriangleMeshInstances.size() };
+		geometryBounds.reserve(geometryCount);
+		geometries.reserve(geometryCount);
+
+		for (uint32_t i{}; i < m_SphereGeometries.size(); ++i)
+		{
+			const Sphere& sphere{ m_SphereGeometries[i] };
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+
+			geometryBounds.push_back({ sphere.origin - extent, sphere.origin + extent });
+			geometries.push_back({ GeometryType::Sphere, i });
+		}
+
+		//The mesh BVHs are the bottom level, their root bounds (moved with the placement of a moved mesh) are all the top level needs
+		for (uint32_t i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			const AABB& rootBounds{ mesh.bvh.GetNodes()[0].bounds };
+			geometryBounds.push_back(mesh.isPlaced ? mesh.placement.TransformBounds(rootBounds) : rootBounds);
+			geometries.push_back({ GeometryType::TriangleMesh, i });
+		}
+
+		//Instances are boxed by the transformed root of their mesh's BVH
+		for (uint32_t i{}; i < m_TriangleMeshInstances.size(); ++i)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[i] };
+			const TriangleMesh& mesh{ m_InstancedMeshes[instance.meshIndex] };
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			geometryBounds.push_back(instance.TransformBounds(mesh.bvh.GetNodes()[0].bounds));
+			geometries.push_back({ GeometryType::MeshInstance, i });
+		}
+	}
+
+	void Scene::CopySpheres()
+	{
+		m_Spheres.Clear();
+		m_Spheres.Reserve(m_SphereOrder.size() + SphereSoA::PaddingCount);
+		for (const uint32_t sphereIndex : m_SphereOrder)
+		{
+			m_Spheres.Add(m_SphereGeometries[sphereIndex]);
+		}
+		m_Spheres.AddPadding();
+	}
+
+	void Scene::BuildAccelerationStructure()
+	{
+		std::vector<AABB> geometryBounds{};
+		std::vector<GeometryReference> geometries{};
+		GetGeometryBounds(geometryBounds, geometries);
+
+		//Leaves hold up to a full batch of spheres, they are tested in one go
+		m_TopLevelBVH.Build(geometryBounds, MaxSimdWidth, m_pThreadPool);
+
+		//Store the references in BVH order so a leaf maps to a contiguous range
+		const std::vector<uint32_t>& primitiveIndices{ m_TopLevelBVH.GetPrimitiveIndices() };
+		m_TopLevelGeometries.clear();
+		m_TopLevelGeometries.reserve(primitiveIndices.size());
+		for (const uint32_t primitiveIndex : primitiveIndices)
+		{
+			m_TopLevelGeometries.push_back(geometries[primitiveIndex]);
+		}
+
+		//Spheres first within every leaf, then copy them to the SoA store in that order
+		//so the spheres of a leaf form one range for the batched kernels
+		for (const BVHNode& node : m_TopLevelBVH.GetNodes())
+		{
+			if (!node.IsLeaf())
+				continue;
+
+			const auto leafBegin{ m_TopLevelGeometries.begin() + node.leftFirst };
+			std::stable_partition(leafBegin, leafBegin + node.primitiveCount, [](const GeometryReference& geometry)
+				{
+					return geometry.type == GeometryType::Sphere;
+				});
+		}
+
+		m_SphereOrder.clear();
+		for (GeometryReference& geometry : m_TopLevelGeometries)
+		{
+			if (geometry.type != GeometryType::Sphere)
+				continue;
+
+			m_SphereOrder.push_back(geometry.index);
+			geometry.index = static_cast<uint32_t>(m_SphereOrder.size() - 1);
+		}
+		CopySpheres();
+
+		m_GeometryBounds = std::move(geometryBounds);
+		m_IsAccelerationStructureDirty = false;
+	}
+
+	void Scene::RefitAccelerationStructure()
+	{
+		std::vector<AABB> geometryBounds{};
+		std::vector<GeometryReference> geometries{};
+		GetGeometryBounds(geometryBounds, geometries);
+
+		//Geometry was added since the last build, or a mesh got its first BVH
+		if (m_IsAccelerationStructureDirty || geometries.size() != m_TopLevelBVH.GetPrimitiveCount())
+		{
+			BuildAccelerationStructure();
+			return;
+		}
+
+		//Nothing moved, e.g. every frame of a static scene
+		const bool isUnchanged{ std::equal(geometryBounds.begin(), geometryBounds.end(), m_GeometryBounds.begin(), m_GeometryBounds.end(), [](const AABB& a, const AABB& b)
+			{
+				return std::memcmp(&a, &b, sizeof(AABB)) == 0;
+			}) };
+		if (isUnchanged)
+			return;
+
+		m_TopLevelBVH.Refit(geometryBounds);
+		if (m_TopLevelBVH.NeedsRebuild())
+		{
+			BuildAccelerationStructure();
+			return;
 		}
 
+		CopySpheres();
+		m_GeometryBounds = std::move(geometryBounds);
+	}
 
+	void Scene::PrintAccelerationStructure(std::ostream& output) const
+	{
+		const auto print{ [&output](const BVHBuildStatistics& statistics)
+			{
+				output << statistics.nodeCount << " nodes (" << statistics.leafCount << " leaves, depth " << statistics.depth
+					<< ", " << statistics.wideNodeCount << " 4-wide), SAH cost " << statistics.sahCost;
+				if (statistics.refitCount > 0)
+					output << " after " << statistics.refitCount << " refit(s) of " << statistics.builtSahCost << " built";
+				if (statistics.buildTime > 0.0)
+					output << ", built in " << statistics.buildTime << " ms" << std::endl;
+				else
+					output << ", from the mesh cache" << std::endl;
+			} };
+
+		if (!m_TopLevelBVH.IsEmpty())
+		{
+			output << "BVH top level, " << m_TopLevelGeometries.size() << " geometries: ";
+			print(m_TopLevelBVH.GetBuildStatistics());
+		}
+
+		for (size_t i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			output << "BVH mesh " << i << ", " << mesh.indices.size() / 3 << " triangles: ";
+			print(mesh.bvh.GetBuildStatistics());
+		}
+
+		for (size_t i{}; i < m_InstancedMeshes.size(); ++i)
+		{
+			const TriangleMesh& mesh{ m_InstancedMeshes[i] };
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			const auto instanceCount{ std::count_if(m_TriangleMeshInstances.begin(), m_TriangleMeshInstances.end(), [i](const TriangleMeshInstance& instance)
+				{
+					return instance.meshIndex == i;
+				}) };
+			output << "BVH instanced mesh " << i << ", " << mesh.indices.size() / 3 << " triangles, " << instanceCount << " instances: ";
+			print(mesh.bvh.GetBuildStatistics());
+		}
 	}
 
 #pragma region Scene Helpers
@@ -105,6 +675,7 @@ namespace dae {
 		s.materialIndex = materialIndex;
 
 		m_SphereGeometries.emplace_back(s);
+		m_IsAccelerationStructureDirty = true;
 		return &m_SphereGeometries.back();
 	}
 
@@ -126,9 +697,34 @@ namespace dae {
 		m.materialIndex = materialIndex;
 
 		m_TriangleMeshGeometries.emplace_back(m);
+		m_IsAccelerationStructureDirty = true;
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	uint32_t Scene::AddInstancedMesh(TriangleCullMode cullMode)
+	{
+		TriangleMesh m{};
+		m.cullMode = cullMode;
+
+		m_InstancedMeshes.emplace_back(m);
+		m_IsAccelerationStructureDirty = true;
+		return static_cast<uint32_t>(m_InstancedMeshes.size() - 1);
+	}
+
+	TriangleMeshInstance* Scene::AddTriangleMeshInstance(uint32_t meshIndex, const Matrix& transform, unsigned char materialIndex)
+	{
+		assert(meshIndex < m_InstancedMeshes.size() && "Unknown instanced mesh, add it with AddInstancedMesh first");
+
+		TriangleMeshInstance instance{};
+		instance.meshIndex = meshIndex;
+		instance.materialIndex = materialIndex;
+		instance.SetTransform(transform);
+
+		m_TriangleMeshInstances.emplace_back(instance);
+		m_IsAccelerationStructureDirty = true;
+		return &m_TriangleMeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -153,10 +749,9 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	unsigned char Scene::AddMaterial(const Material& material)
 	{
-		m_Materials.push_back(pMaterial);
-		return static_cast<unsigned char>(m_Materials.size() - 1);
+		return m_Materials.Add(material);
 	}
 #pragma endregion
 #pragma endregion
@@ -166,11 +761,11 @@ namespace dae {
 	{
 				//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const unsigned char matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -193,11 +788,11 @@ namespace dae {
 
 		//default:: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const unsigned char matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 
 		//Plane
 		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f,0.f }, matId_Solid_Green);
@@ -226,14 +821,14 @@ namespace dae {
 	{
 		m_Camera = Camera{ { 0.f, 3.f, -9.f }, 45.f };
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, 0.f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, 0.f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, 0.f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material_CookTorrence({ .972, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material_CookTorrence({ .972, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material_CookTorrence({ .972, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material_CookTorrence({ .75f, .75f, .75f }, 0.f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material_CookTorrence({ .75f, .75f, .75f }, 0.f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material_CookTorrence({ .75f, .75f, .75f }, 0.f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, .57f, .57f }, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ .49f, .57f, .57f }, 1.f));
 
 
 		//Plane
@@ -244,9 +839,9 @@ namespace dae {
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue);; //Left
 
 		//temp material & spheres
-		/*const auto matLambertPhong1 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 3.f));
-		const auto matLambertPhong2 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 15.f));
-		const auto matLambertPhong3 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 50.f));
+		/*const auto matLambertPhong1 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 3.f));
+		const auto matLambertPhong2 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 15.f));
+		const auto matLambertPhong3 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 50.f));
 
 		AddSphere(Vector3{ -1.75, 1.f, 0.f }, .75f, matLambertPhong1);
 		AddSphere(Vector3{ 0, 1.f, 0.f }, .75f, matLambertPhong2);
@@ -279,8 +874,8 @@ namespace dae {
 		m_Camera = { { 0.f, 1.f, -5.f }, 45.f };
 
 		//Materials
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
 
 		//Plane
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue);; //Back
@@ -315,7 +910,7 @@ namespace dae {
 		triangleMesh->Translate({ 0.f, 1.5f, 0.f });
 		triangleMesh->RotateY(45.f);
 
-		triangleMesh->UpdateTransforms();
+		triangleMesh->UpdateTransforms(m_pThreadPool);
 
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, 0.61f, .45f });//backLight
@@ -326,4 +921,98 @@ namespace dae {
 
 
 #pragma endregion
+
+#pragma region SCENE W4 BUNNY
+
+	void Scene_W4_Bunny::Initialize()
+	{
+		m_Camera = { { 0.f, 3.f, -9.f }, 45.f };
+
+		//Materials
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
+
+		//Plane
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //Back
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //Bottom
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matLambert_GrayBlue); //Top
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue); //Right
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //Left
+
+		//Bunny
+		//Transform first, the mesh cache stores the BVH built for it
+		const auto pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
+		pMesh->Scale({ 2.f, 2.f, 2.f });
+		pMesh->RotateY(PI);
+
+		if (!MeshCache::LoadOBJ("Resources/lowpoly_bunny.obj", *pMesh, m_pThreadPool))
+			std::cout << "Scene_W4_Bunny: could not load Resources/lowpoly_bunny.obj" << std::endl;
+
+		//Light
+		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, 0.61f, .45f }); //Back light
+		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, 0.8f, .45f }); //Front light left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, 0.47f, .68f });
+	}
+
+#pragma endregion
+
+#pragma region SCENE INSTANCES
+
+	void Scene_Instances::Initialize()
+	{
+		//Looking down on the field
+		m_Camera = { { 0.f, 9.f, -10.f }, 45.f };
+		m_Camera.totalPitch = -0.45f;
+		m_Camera.forward = Matrix::CreateRotationX(m_Camera.totalPitch).TransformVector(Vector3::UnitZ);
+
+		//Materials
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const unsigned char matInstances[]{
+			AddMaterial(Material_Lambert(colors::White, 1.f)),
+			AddMaterial(Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .3f)),
+			AddMaterial(Material_LambertPhong({ .85f, .55f, .35f }, .6f, .4f, 20.f)) };
+
+		//Plane
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //Bottom
+		AddPlane(Vector3{ 0.f, 0.f, 40.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //Back
+
+		//Bunnies, one mesh and BVH for all of them
+		const uint32_t bunny{ AddInstancedMesh(TriangleCullMode::BackFaceCulling) };
+		if (!MeshCache::LoadOBJ("Resources/lowpoly_bunny.obj", m_InstancedMeshes[bunny], m_pThreadPool))
+			std::cout << "Scene_Instances: could not load Resources/lowpoly_bunny.obj" << std::endl;
+
+		constexpr int columnCount{ 10 };
+		constexpr int rowCount{ 12 };
+		for (int row{}; row < rowCount; ++row)
+		{
+			for (int column{}; column < columnCount; ++column)
+			{
+				const int index{ row * columnCount + column };
+				const float scale{ 0.8f + 0.1f * (index % 5) };
+				const Vector3 position{ (column - (columnCount - 1) * 0.5f) * 2.5f, 0.f, row * 2.5f };
+
+				AddTriangleMeshInstance(bunny,
+					Matrix::CreateScale(scale, scale, scale) * Matrix::CreateRotationY(PI + 0.7f * index) * Matrix::CreateTranslation(position),
+					matInstances[index % 3]);
+			}
+		}
+
+		//Light
+		AddPointLight(Vector3{ 0.f, 15.f, -5.f }, 600.f, ColorRGB{ 1.f, 0.8f, .45f }); //Front light
+		AddPointLight(Vector3{ -10.f, 10.f, 20.f }, 300.f, ColorRGB{ .34f, 0.47f, .68f });
+		AddPointLight(Vector3{ 10.f, 10.f, 20.f }, 300.f, ColorRGB{ 1.f, 0.61f, .45f });
+	}
+
+#pragma endregion
+
+	Scene* CreateScene(const std::string& name)
+	{
+		if (name == "W1") return new Scene_W1();
+		if (name == "W2") return new Scene_W2();
+		if (name == "W3") return new Scene_W3();
+		if (name == "W4") return new Scene_W4();
+		if (name == "Bunny") return new Scene_W4_Bunny();
+		if (name == "Instances") return new Scene_Instances();
+		return nullptr;
+	}
 }
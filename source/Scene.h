@@ -1,19 +1,39 @@
 #pragma once
+#include <iosfwd>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
+	struct RayPacket;
+
+	//Primitive that blocked the last shadow ray toward one light. Neighbouring shadow rays toward the same light
+	//are usually blocked by it too, so DoesHit tests it before traversing the scene. It is cleared by an unoccluded
+	//ray, lit areas then skip the test. Keep one per thread and light, an entry that no longer fits the scene is ignored.
+	struct OccluderCache
+	{
+		enum class Type : uint8_t
+		{
+			None,
+			Sphere, //index into the sphere store
+			Triangle, //index into the triangle store of mesh meshIndex
+			InstanceTriangle //index into the triangle store of the instanced mesh of instance meshIndex
+		};
+
+		Type type{ Type::None };
+		uint32_t index{};
+		uint32_t meshIndex{};
+	};
 
 	//Scene Base Class
 	class Scene
@@ -27,20 +47,58 @@ namespace dae
 		Scene& operator=(const Scene&) = delete;
 		Scene& operator=(Scene&&) noexcept = delete;
 
+		//Threads for the BVH builds of the scene (e.g. the renderer's), set before Initialize. nullptr builds on the calling thread
+		void SetThreadPool(ThreadPool* pThreadPool) { m_pThreadPool = pThreadPool; }
+
 		virtual void Initialize() = 0;
 		virtual void Update(dae::Timer* pTimer)
 		{
 			m_Camera.Update(pTimer);
+
+			//Geometry moved since the last frame (e.g. by an override before calling this) only needs a refit, which returns
+			//early when nothing moved
+			if (m_IsAccelerationStructureDirty)
+				BuildAccelerationStructure();
+			else
+				RefitAccelerationStructure();
 		}
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
-		bool DoesHit(const Ray& ray) const;
+		bool DoesHit(const Ray& ray, OccluderCache* pOccluderCache = nullptr) const;
+
+		/**
+		 * \brief Closest hits of a packet of primary rays, traced through the BVHs together. Packets whose rays
+		 * point into different octants, or a forced scalar SIMD level, trace the rays one by one instead.
+		 * \param packet rays to trace
+		 * \param pClosestHits one hit record per ray of the packet
+		 */
+		void GetClosestHits(const RayPacket& packet, HitRecord* pClosestHits) const;
+
+		/**
+		 * \brief Any hit test of a packet of rays (e.g. shadow rays of neighbouring pixels toward one light), falls back
+		 * to single rays like GetClosestHits
+		 * \param packet rays to test, each within its own [min, max]
+		 * \param pOccluderCache last occluder toward the same light, tested first and replaced by the occluders found
+		 * (cleared when no ray is occluded)
+		 * \return bit per ray that hits something
+		 */
+		int DoesHit(const RayPacket& packet, OccluderCache* pOccluderCache = nullptr) const;
+
+		void BuildAccelerationStructure();
+		/**
+		 * \brief Fits the top level BVH to geometry that moved (meshes after TriangleMesh::UpdateTransforms or UpdateRigidTransform,
+		 * spheres with a new origin or radius, instances after TriangleMeshInstance::SetTransform) instead of building it again, e.g. every frame of an animation.
+		 * Does nothing when no bounds changed since the last build or refit, builds it when geometry was added since, or when the refits degraded it past BVH::MaxDegradation.
+		 */
+		void RefitAccelerationStructure();
+		//Node count, SAH cost and build time of the top level BVH and every mesh BVH
+		void PrintAccelerationStructure(std::ostream& output) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const MaterialTable& GetMaterials() const { return m_Materials; }
 
 	protected:
 		std::string	sceneName;
@@ -49,20 +107,76 @@ namespace dae
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		MaterialTable m_Materials{};
 
 		//Temp Triangle
 		std::vector<Triangle> m_Triangles;
 
+		//Shared meshes (each with its BVH) that are only traced through the instances placing them
+		std::vector<TriangleMesh> m_InstancedMeshes{};
+		std::vector<TriangleMeshInstance> m_TriangleMeshInstances{};
+
+		//Top level BVH over every bounded geometry (spheres and mesh BVHs), planes are infinite and stay a plain list
+		enum class GeometryType
+		{
+			Sphere,
+			TriangleMesh,
+			MeshInstance
+		};
+
+		struct GeometryReference
+		{
+			GeometryType type{};
+			uint32_t index{}; //Spheres: index in m_Spheres, meshes: index in m_TriangleMeshGeometries, instances: index in m_TriangleMeshInstances
+		};
+
+		BVH m_TopLevelBVH{};
+		std::vector<GeometryReference> m_TopLevelGeometries{}; //In BVH primitive order, spheres first within a leaf
+		SphereSoA m_Spheres{}; //Copy of m_SphereGeometries in traversal order for the batched kernels
+		std::vector<uint32_t> m_SphereOrder{}; //Index in m_SphereGeometries of every sphere in m_Spheres
+		std::vector<AABB> m_GeometryBounds{}; //GetGeometryBounds of the last build or refit
+		bool m_IsAccelerationStructureDirty{ true };
+		ThreadPool* m_pThreadPool{};
+
 		Camera m_Camera{};
 
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Mesh for instances, filled and transformed like any other mesh (m_InstancedMeshes[index]), returns its index
+		uint32_t AddInstancedMesh(TriangleCullMode cullMode);
+		//Places the instanced mesh meshIndex, transform (object to world) goes on top of the mesh's own transform
+		TriangleMeshInstance* AddTriangleMeshInstance(uint32_t meshIndex, const Matrix& transform, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		unsigned char AddMaterial(const Material& material);
+
+		//Bounds of every sphere and every mesh with a BVH, in this order, and what they belong to
+		void GetGeometryBounds(std::vector<AABB>& geometryBounds, std::vector<GeometryReference>& geometries) const;
+		//Copies the spheres to m_Spheres in m_SphereOrder
+		void CopySpheres();
+
+		const TriangleMesh& GetInstancedMesh(uint32_t instanceIndex) const { return m_InstancedMeshes[m_TriangleMeshInstances[instanceIndex].meshIndex]; }
+		//Mesh traced for a mesh or instance geometry
+		const TriangleMesh& GetMesh(const GeometryReference& geometry) const
+		{
+			return geometry.type == GeometryType::MeshInstance ? GetInstancedMesh(geometry.index) : m_TriangleMeshGeometries[geometry.index];
+		}
+		//What rays go through into the space of that mesh (the instance, or a moved mesh's placement), nullptr to trace it as it is
+		const TriangleMeshInstance* GetPlacement(const GeometryReference& geometry) const
+		{
+			if (geometry.type == GeometryType::MeshInstance)
+				return &m_TriangleMeshInstances[geometry.index];
+
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[geometry.index] };
+			return mesh.isPlaced ? &mesh.placement : nullptr;
+		}
+
+		//False for an empty cache or one left over from other geometry
+		bool IsOccluderValid(const OccluderCache& occluderCache) const;
+		//Any hit test of a shadow ray against the cached occluder, which has to be valid
+		bool HitTest_Occluder(const OccluderCache& occluderCache, const Ray& ray) const;
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -131,4 +245,45 @@ namespace dae
 
 		void Initialize() override;
 	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//WEEK 4 Bunny Scene (lowpoly_bunny.obj, loaded relative to the working directory)
+
+	class Scene_W4_Bunny final : public Scene
+	{
+	public:
+		Scene_W4_Bunny() = default;
+		~Scene_W4_Bunny() override = default;
+
+		Scene_W4_Bunny(const Scene_W4_Bunny&) = delete;
+		Scene_W4_Bunny(Scene_W4_Bunny&&) noexcept = delete;
+		Scene_W4_Bunny& operator=(const Scene_W4_Bunny&) = delete;
+		Scene_W4_Bunny& operator=(Scene_W4_Bunny&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//Instancing Scene (a field of lowpoly_bunny.obj instances sharing one mesh and BVH)
+
+	class Scene_Instances final : public Scene
+	{
+	public:
+		Scene_Instances() = default;
+		~Scene_Instances() override = default;
+
+		Scene_Instances(const Scene_Instances&) = delete;
+		Scene_Instances(Scene_Instances&&) noexcept = delete;
+		Scene_Instances& operator=(const Scene_Instances&) = delete;
+		Scene_Instances& operator=(Scene_Instances&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	/**
+	 * \brief Creates a scene by name, for command line and batch use
+	 * \param name "W1", "W2", "W3", "W4", "Bunny" or "Instances"
+	 * \return new (uninitialized) scene owned by the caller, nullptr for an unknown name
+	 */
+	Scene* CreateScene(const std::string& name);
 }
@@ -0,0 +1,555 @@
+#include "Simd.h"
+
+#include <bit>
+
+#include "Statistics.h"
+#include "Utils.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace dae
+{
+	namespace Simd
+	{
+		using TriangleKernel = uint32_t(*)(const TriangleSoA&, uint32_t, uint32_t, Ray&, TriangleCullMode, bool);
+		using SphereKernel = uint32_t(*)(const SphereSoA&, uint32_t, uint32_t, Ray&, bool);
+		using TransformKernel = void(*)(const Matrix&, const float*, const float*, const float*, uint32_t, float*, float*, float*);
+
+#pragma region Scalar Kernels
+		static uint32_t IntersectTriangles_Scalar(const TriangleSoA& triangles, uint32_t first, uint32_t count, Ray& ray, TriangleCullMode cullMode, bool anyHit)
+		{
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				if (GeometryUtils::HitTest_Triangle(triangles, i, ray, cullMode, ray.max))
+				{
+					hitIndex = i;
+					if (anyHit)
+						break;
+				}
+			}
+			return hitIndex;
+		}
+
+		static uint32_t IntersectSpheres_Scalar(const SphereSoA& spheres, uint32_t first, uint32_t count, Ray& ray, bool anyHit)
+		{
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t i{ first }; i < first + count; ++i)
+			{
+				if (GeometryUtils::HitTest_Sphere(spheres, i, ray, ray.max))
+				{
+					hitIndex = i;
+					if (anyHit)
+						break;
+				}
+			}
+			return hitIndex;
+		}
+
+		static void TransformDirections_Scalar(const Matrix& transform, const float* pX, const float* pY, const float* pZ, uint32_t count, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			for (uint32_t i{}; i < count; ++i)
+			{
+				const Vector3 direction{ transform.TransformVector(pX[i], pY[i], pZ[i]) };
+				pOutX[i] = direction.x;
+				pOutY[i] = direction.y;
+				pOutZ[i] = direction.z;
+			}
+		}
+#pragma endregion
+
+#if defined(DAE_SIMD_X86)
+#pragma region SSE Kernels
+		static uint32_t IntersectTriangles_SSE(const TriangleSoA& triangles, uint32_t first, uint32_t count, Ray& ray, TriangleCullMode cullMode, bool anyHit)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 laneIndex{ _mm_setr_ps(0.f, 1.f, 2.f, 3.f) };
+
+			const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+			const __m128 tMin{ _mm_set1_ps(ray.min) };
+
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t batch{ first }; batch < first + count; batch += 4)
+			{
+				const __m128 edge1X{ _mm_loadu_ps(&triangles.edge1X[batch]) };
+				const __m128 edge1Y{ _mm_loadu_ps(&triangles.edge1Y[batch]) };
+				const __m128 edge1Z{ _mm_loadu_ps(&triangles.edge1Z[batch]) };
+				const __m128 edge2X{ _mm_loadu_ps(&triangles.edge2X[batch]) };
+				const __m128 edge2Y{ _mm_loadu_ps(&triangles.edge2Y[batch]) };
+				const __m128 edge2Z{ _mm_loadu_ps(&triangles.edge2Z[batch]) };
+
+				//pVector = Cross(direction, edge2), det = Dot(edge1, pVector)
+				const __m128 pX{ _mm_sub_ps(_mm_mul_ps(directionY, edge2Z), _mm_mul_ps(directionZ, edge2Y)) };
+				const __m128 pY{ _mm_sub_ps(_mm_mul_ps(directionZ, edge2X), _mm_mul_ps(directionX, edge2Z)) };
+				const __m128 pZ{ _mm_sub_ps(_mm_mul_ps(directionX, edge2Y), _mm_mul_ps(directionY, edge2X)) };
+				const __m128 det{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ)) };
+
+				//Lanes past the end of the range read padding, mask them out
+				__m128 valid{ _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(first + count - batch))) };
+				switch (cullMode)
+				{
+				case TriangleCullMode::BackFaceCulling:
+					valid = _mm_and_ps(valid, _mm_cmpgt_ps(det, zero));
+					break;
+				case TriangleCullMode::FrontFaceCulling:
+					valid = _mm_and_ps(valid, _mm_cmplt_ps(det, zero));
+					break;
+				default:
+					valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+					break;
+				}
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+
+				const __m128 invDet{ _mm_div_ps(one, det) };
+				const __m128 tX{ _mm_sub_ps(originX, _mm_loadu_ps(&triangles.v0X[batch])) };
+				const __m128 tY{ _mm_sub_ps(originY, _mm_loadu_ps(&triangles.v0Y[batch])) };
+				const __m128 tZ{ _mm_sub_ps(originZ, _mm_loadu_ps(&triangles.v0Z[batch])) };
+
+				const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tX, pX), _mm_mul_ps(tY, pY)), _mm_mul_ps(tZ, pZ)), invDet) };
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+				//qVector = Cross(tVector, edge1)
+				const __m128 qX{ _mm_sub_ps(_mm_mul_ps(tY, edge1Z), _mm_mul_ps(tZ, edge1Y)) };
+				const __m128 qY{ _mm_sub_ps(_mm_mul_ps(tZ, edge1X), _mm_mul_ps(tX, edge1Z)) };
+				const __m128 qZ{ _mm_sub_ps(_mm_mul_ps(tX, edge1Y), _mm_mul_ps(tY, edge1X)) };
+
+				const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qX), _mm_mul_ps(directionY, qY)), _mm_mul_ps(directionZ, qZ)), invDet) };
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 t{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), invDet) };
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, tMin), _mm_cmple_ps(t, _mm_set1_ps(ray.max))));
+
+				int hitMask{ _mm_movemask_ps(valid) };
+				if (hitMask == 0)
+					continue;
+
+				alignas(16) float hitT[4]{};
+				_mm_store_ps(hitT, t);
+				while (hitMask != 0)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+					hitMask &= hitMask - 1;
+					if (hitT[lane] <= ray.max)
+					{
+						ray.max = hitT[lane];
+						hitIndex = batch + lane;
+					}
+				}
+
+				if (anyHit)
+					break;
+			}
+			return hitIndex;
+		}
+
+		static uint32_t IntersectSpheres_SSE(const SphereSoA& spheres, uint32_t first, uint32_t count, Ray& ray, bool anyHit)
+		{
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 laneIndex{ _mm_setr_ps(0.f, 1.f, 2.f, 3.f) };
+
+			const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+			const __m128 a{ _mm_set1_ps(Vector3::Dot(ray.direction, ray.direction)) };
+			const __m128 tMin{ _mm_set1_ps(ray.min) };
+
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t batch{ first }; batch < first + count; batch += 4)
+			{
+				const __m128 toCenterX{ _mm_sub_ps(originX, _mm_loadu_ps(&spheres.originX[batch])) };
+				const __m128 toCenterY{ _mm_sub_ps(originY, _mm_loadu_ps(&spheres.originY[batch])) };
+				const __m128 toCenterZ{ _mm_sub_ps(originZ, _mm_loadu_ps(&spheres.originZ[batch])) };
+				const __m128 radius{ _mm_loadu_ps(&spheres.radius[batch]) };
+
+				//Half-b form of the quadratic
+				const __m128 halfB{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, toCenterX), _mm_mul_ps(directionY, toCenterY)), _mm_mul_ps(directionZ, toCenterZ)) };
+				const __m128 c{ _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toCenterX, toCenterX), _mm_mul_ps(toCenterY, toCenterY)), _mm_mul_ps(toCenterZ, toCenterZ)), _mm_mul_ps(radius, radius)) };
+				const __m128 discriminant{ _mm_sub_ps(_mm_mul_ps(halfB, halfB), _mm_mul_ps(a, c)) };
+
+				//Lanes past the end of the range read padding, mask them out
+				__m128 valid{ _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(first + count - batch))) };
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(discriminant, zero));
+				if (_mm_movemask_ps(valid) == 0)
+					continue;
+
+				const __m128 t{ _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, halfB), _mm_sqrt_ps(_mm_max_ps(discriminant, zero))), a) };
+				valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, tMin), _mm_cmple_ps(t, _mm_set1_ps(ray.max))));
+
+				int hitMask{ _mm_movemask_ps(valid) };
+				if (hitMask == 0)
+					continue;
+
+				alignas(16) float hitT[4]{};
+				_mm_store_ps(hitT, t);
+				while (hitMask != 0)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+					hitMask &= hitMask - 1;
+					if (hitT[lane] <= ray.max)
+					{
+						ray.max = hitT[lane];
+						hitIndex = batch + lane;
+					}
+				}
+
+				if (anyHit)
+					break;
+			}
+			return hitIndex;
+		}
+
+		static void TransformDirections_SSE(const Matrix& transform, const float* pX, const float* pY, const float* pZ, uint32_t count, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			//Same products and sums in the same order as Matrix::TransformVector
+			const __m128 m00{ _mm_set1_ps(transform[0].x) }, m01{ _mm_set1_ps(transform[0].y) }, m02{ _mm_set1_ps(transform[0].z) };
+			const __m128 m10{ _mm_set1_ps(transform[1].x) }, m11{ _mm_set1_ps(transform[1].y) }, m12{ _mm_set1_ps(transform[1].z) };
+			const __m128 m20{ _mm_set1_ps(transform[2].x) }, m21{ _mm_set1_ps(transform[2].y) }, m22{ _mm_set1_ps(transform[2].z) };
+
+			uint32_t i{};
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 x{ _mm_loadu_ps(pX + i) };
+				const __m128 y{ _mm_loadu_ps(pY + i) };
+				const __m128 z{ _mm_loadu_ps(pZ + i) };
+
+				_mm_storeu_ps(pOutX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_mul_ps(m20, z)));
+				_mm_storeu_ps(pOutY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m21, z)));
+				_mm_storeu_ps(pOutZ + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_mul_ps(m22, z)));
+			}
+
+			TransformDirections_Scalar(transform, pX + i, pY + i, pZ + i, count - i, pOutX + i, pOutY + i, pOutZ + i);
+		}
+#pragma endregion
+
+#pragma region AVX2 Kernels
+		DAE_TARGET_AVX2 static uint32_t IntersectTriangles_AVX2(const TriangleSoA& triangles, uint32_t first, uint32_t count, Ray& ray, TriangleCullMode cullMode, bool anyHit)
+		{
+			const __m256 zero{ _mm256_setzero_ps() };
+			const __m256 one{ _mm256_set1_ps(1.f) };
+			const __m256 laneIndex{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+
+			const __m256 originX{ _mm256_set1_ps(ray.origin.x) };
+			const __m256 originY{ _mm256_set1_ps(ray.origin.y) };
+			const __m256 originZ{ _mm256_set1_ps(ray.origin.z) };
+			const __m256 directionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 directionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 directionZ{ _mm256_set1_ps(ray.direction.z) };
+			const __m256 tMin{ _mm256_set1_ps(ray.min) };
+
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t batch{ first }; batch < first + count; batch += 8)
+			{
+				const __m256 edge1X{ _mm256_loadu_ps(&triangles.edge1X[batch]) };
+				const __m256 edge1Y{ _mm256_loadu_ps(&triangles.edge1Y[batch]) };
+				const __m256 edge1Z{ _mm256_loadu_ps(&triangles.edge1Z[batch]) };
+				const __m256 edge2X{ _mm256_loadu_ps(&triangles.edge2X[batch]) };
+				const __m256 edge2Y{ _mm256_loadu_ps(&triangles.edge2Y[batch]) };
+				const __m256 edge2Z{ _mm256_loadu_ps(&triangles.edge2Z[batch]) };
+
+				//pVector = Cross(direction, edge2), det = Dot(edge1, pVector)
+				const __m256 pX{ _mm256_fmsub_ps(directionY, edge2Z, _mm256_mul_ps(directionZ, edge2Y)) };
+				const __m256 pY{ _mm256_fmsub_ps(directionZ, edge2X, _mm256_mul_ps(directionX, edge2Z)) };
+				const __m256 pZ{ _mm256_fmsub_ps(directionX, edge2Y, _mm256_mul_ps(directionY, edge2X)) };
+				const __m256 det{ _mm256_fmadd_ps(edge1X, pX, _mm256_fmadd_ps(edge1Y, pY, _mm256_mul_ps(edge1Z, pZ))) };
+
+				//Lanes past the end of the range read padding, mask them out
+				__m256 valid{ _mm256_cmp_ps(laneIndex, _mm256_set1_ps(static_cast<float>(first + count - batch)), _CMP_LT_OQ) };
+				switch (cullMode)
+				{
+				case TriangleCullMode::BackFaceCulling:
+					valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_GT_OQ));
+					break;
+				case TriangleCullMode::FrontFaceCulling:
+					valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_LT_OQ));
+					break;
+				default:
+					valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+					break;
+				}
+				if (_mm256_movemask_ps(valid) == 0)
+					continue;
+
+				const __m256 invDet{ _mm256_div_ps(one, det) };
+				const __m256 tX{ _mm256_sub_ps(originX, _mm256_loadu_ps(&triangles.v0X[batch])) };
+				const __m256 tY{ _mm256_sub_ps(originY, _mm256_loadu_ps(&triangles.v0Y[batch])) };
+				const __m256 tZ{ _mm256_sub_ps(originZ, _mm256_loadu_ps(&triangles.v0Z[batch])) };
+
+				const __m256 u{ _mm256_mul_ps(_mm256_fmadd_ps(tX, pX, _mm256_fmadd_ps(tY, pY, _mm256_mul_ps(tZ, pZ))), invDet) };
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+
+				//qVector = Cross(tVector, edge1)
+				const __m256 qX{ _mm256_fmsub_ps(tY, edge1Z, _mm256_mul_ps(tZ, edge1Y)) };
+				const __m256 qY{ _mm256_fmsub_ps(tZ, edge1X, _mm256_mul_ps(tX, edge1Z)) };
+				const __m256 qZ{ _mm256_fmsub_ps(tX, edge1Y, _mm256_mul_ps(tY, edge1X)) };
+
+				const __m256 v{ _mm256_mul_ps(_mm256_fmadd_ps(directionX, qX, _mm256_fmadd_ps(directionY, qY, _mm256_mul_ps(directionZ, qZ))), invDet) };
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+
+				const __m256 t{ _mm256_mul_ps(_mm256_fmadd_ps(edge2X, qX, _mm256_fmadd_ps(edge2Y, qY, _mm256_mul_ps(edge2Z, qZ))), invDet) };
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ)));
+
+				int hitMask{ _mm256_movemask_ps(valid) };
+				if (hitMask == 0)
+					continue;
+
+				alignas(32) float hitT[8]{};
+				_mm256_store_ps(hitT, t);
+				while (hitMask != 0)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+					hitMask &= hitMask - 1;
+					if (hitT[lane] <= ray.max)
+					{
+						ray.max = hitT[lane];
+						hitIndex = batch + lane;
+					}
+				}
+
+				if (anyHit)
+					break;
+			}
+			return hitIndex;
+		}
+
+		DAE_TARGET_AVX2 static uint32_t IntersectSpheres_AVX2(const SphereSoA& spheres, uint32_t first, uint32_t count, Ray& ray, bool anyHit)
+		{
+			const __m256 zero{ _mm256_setzero_ps() };
+			const __m256 laneIndex{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+
+			const __m256 originX{ _mm256_set1_ps(ray.origin.x) };
+			const __m256 originY{ _mm256_set1_ps(ray.origin.y) };
+			const __m256 originZ{ _mm256_set1_ps(ray.origin.z) };
+			const __m256 directionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 directionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 directionZ{ _mm256_set1_ps(ray.direction.z) };
+			const __m256 a{ _mm256_set1_ps(Vector3::Dot(ray.direction, ray.direction)) };
+			const __m256 tMin{ _mm256_set1_ps(ray.min) };
+
+			uint32_t hitIndex{ UINT32_MAX };
+			for (uint32_t batch{ first }; batch < first + count; batch += 8)
+			{
+				const __m256 toCenterX{ _mm256_sub_ps(originX, _mm256_loadu_ps(&spheres.originX[batch])) };
+				const __m256 toCenterY{ _mm256_sub_ps(originY, _mm256_loadu_ps(&spheres.originY[batch])) };
+				const __m256 toCenterZ{ _mm256_sub_ps(originZ, _mm256_loadu_ps(&spheres.originZ[batch])) };
+				const __m256 radius{ _mm256_loadu_ps(&spheres.radius[batch]) };
+
+				//Half-b form of the quadratic
+				const __m256 halfB{ _mm256_fmadd_ps(directionX, toCenterX, _mm256_fmadd_ps(directionY, toCenterY, _mm256_mul_ps(directionZ, toCenterZ))) };
+				const __m256 c{ _mm256_fmadd_ps(toCenterX, toCenterX, _mm256_fmadd_ps(toCenterY, toCenterY, _mm256_fmsub_ps(toCenterZ, toCenterZ, _mm256_mul_ps(radius, radius)))) };
+				const __m256 discriminant{ _mm256_fmsub_ps(halfB, halfB, _mm256_mul_ps(a, c)) };
+
+				//Lanes past the end of the range read padding, mask them out
+				__m256 valid{ _mm256_cmp_ps(laneIndex, _mm256_set1_ps(static_cast<float>(first + count - batch)), _CMP_LT_OQ) };
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(valid) == 0)
+					continue;
+
+				const __m256 t{ _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(zero, halfB), _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero))), a) };
+				valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ)));
+
+				int hitMask{ _mm256_movemask_ps(valid) };
+				if (hitMask == 0)
+					continue;
+
+				alignas(32) float hitT[8]{};
+				_mm256_store_ps(hitT, t);
+				while (hitMask != 0)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+					hitMask &= hitMask - 1;
+					if (hitT[lane] <= ray.max)
+					{
+						ray.max = hitT[lane];
+						hitIndex = batch + lane;
+					}
+				}
+
+				if (anyHit)
+					break;
+			}
+			return hitIndex;
+		}
+
+		DAE_TARGET_AVX2 static void TransformDirections_AVX2(const Matrix& transform, const float* pX, const float* pY, const float* pZ, uint32_t count, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			const __m256 m00{ _mm256_set1_ps(transform[0].x) }, m01{ _mm256_set1_ps(transform[0].y) }, m02{ _mm256_set1_ps(transform[0].z) };
+			const __m256 m10{ _mm256_set1_ps(transform[1].x) }, m11{ _mm256_set1_ps(transform[1].y) }, m12{ _mm256_set1_ps(transform[1].z) };
+			const __m256 m20{ _mm256_set1_ps(transform[2].x) }, m21{ _mm256_set1_ps(transform[2].y) }, m22{ _mm256_set1_ps(transform[2].z) };
+
+			uint32_t i{};
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256 x{ _mm256_loadu_ps(pX + i) };
+				const __m256 y{ _mm256_loadu_ps(pY + i) };
+				const __m256 z{ _mm256_loadu_ps(pZ + i) };
+
+				_mm256_storeu_ps(pOutX + i, _mm256_fmadd_ps(m20, z, _mm256_fmadd_ps(m10, y, _mm256_mul_ps(m00, x))));
+				_mm256_storeu_ps(pOutY + i, _mm256_fmadd_ps(m21, z, _mm256_fmadd_ps(m11, y, _mm256_mul_ps(m01, x))));
+				_mm256_storeu_ps(pOutZ + i, _mm256_fmadd_ps(m22, z, _mm256_fmadd_ps(m12, y, _mm256_mul_ps(m02, x))));
+			}
+
+			TransformDirections_SSE(transform, pX + i, pY + i, pZ + i, count - i, pOutX + i, pOutY + i, pOutZ + i);
+		}
+#pragma endregion
+#endif
+
+#pragma region Dispatch
+		static Level DetectSupportedLevel()
+		{
+#if defined(DAE_SIMD_X86)
+#if defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 1);
+			const bool hasOSXSave{ (info[2] & (1 << 27)) != 0 };
+			const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+			const bool hasFMA{ (info[2] & (1 << 12)) != 0 };
+
+			//The OS has to save the YMM registers on context switches
+			const bool hasYMMState{ hasOSXSave && (_xgetbv(0) & 0x6) == 0x6 };
+
+			__cpuidex(info, 7, 0);
+			const bool hasAVX2{ (info[1] & (1 << 5)) != 0 };
+
+			if (hasAVX && hasYMMState && hasAVX2 && hasFMA)
+				return Level::AVX2;
+#else
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+				return Level::AVX2;
+#endif
+			//SSE2 is part of x86-64
+			return Level::SSE;
+#else
+			return Level::Scalar;
+#endif
+		}
+
+		static TriangleKernel GetTriangleKernel(Level level)
+		{
+			switch (level)
+			{
+#if defined(DAE_SIMD_X86)
+			case Level::AVX2:
+				return IntersectTriangles_AVX2;
+			case Level::SSE:
+				return IntersectTriangles_SSE;
+#endif
+			default:
+				return IntersectTriangles_Scalar;
+			}
+		}
+
+		static SphereKernel GetSphereKernel(Level level)
+		{
+			switch (level)
+			{
+#if defined(DAE_SIMD_X86)
+			case Level::AVX2:
+				return IntersectSpheres_AVX2;
+			case Level::SSE:
+				return IntersectSpheres_SSE;
+#endif
+			default:
+				return IntersectSpheres_Scalar;
+			}
+		}
+
+		static TransformKernel GetTransformKernel(Level level)
+		{
+			switch (level)
+			{
+#if defined(DAE_SIMD_X86)
+			case Level::AVX2:
+				return TransformDirections_AVX2;
+			case Level::SSE:
+				return TransformDirections_SSE;
+#endif
+			default:
+				return TransformDirections_Scalar;
+			}
+		}
+
+		static Level g_Level{ GetSupportedLevel() };
+		static TriangleKernel g_pTriangleKernel{ GetTriangleKernel(g_Level) };
+		static SphereKernel g_pSphereKernel{ GetSphereKernel(g_Level) };
+		static TransformKernel g_pTransformKernel{ GetTransformKernel(g_Level) };
+
+		Level GetSupportedLevel()
+		{
+			static const Level supportedLevel{ DetectSupportedLevel() };
+			return supportedLevel;
+		}
+
+		Level GetLevel()
+		{
+			return g_Level;
+		}
+
+		uint32_t GetWidth()
+		{
+			switch (g_Level)
+			{
+			case Level::AVX2:
+				return 8;
+			case Level::SSE:
+				return 4;
+			default:
+				return 1;
+			}
+		}
+
+		void SetLevel(Level level)
+		{
+			g_Level = std::min(level, GetSupportedLevel());
+			g_pTriangleKernel = GetTriangleKernel(g_Level);
+			g_pSphereKernel = GetSphereKernel(g_Level);
+			g_pTransformKernel = GetTransformKernel(g_Level);
+		}
+
+		const char* ToString(Level level)
+		{
+			switch (level)
+			{
+			case Level::AVX2:
+				return "AVX2";
+			case Level::SSE:
+				return "SSE";
+			default:
+				return "Scalar";
+			}
+		}
+
+		uint32_t IntersectTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, Ray& ray, TriangleCullMode cullMode, bool anyHit)
+		{
+			DAE_STATISTICS_ADD(triangleTests, count);
+			return g_pTriangleKernel(triangles, first, count, ray, cullMode, anyHit);
+		}
+
+		uint32_t IntersectSpheres(const SphereSoA& spheres, uint32_t first, uint32_t count, Ray& ray, bool anyHit)
+		{
+			DAE_STATISTICS_ADD(sphereTests, count);
+			return g_pSphereKernel(spheres, first, count, ray, anyHit);
+		}
+
+		void TransformDirections(const Matrix& transform, const float* pX, const float* pY, const float* pZ, uint32_t count, float* pOutX, float* pOutY, float* pOutZ)
+		{
+			g_pTransformKernel(transform, pX, pY, pZ, count, pOutX, pOutY, pOutZ);
+		}
+#pragma endregion
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+
+#include "DataTypes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DAE_SIMD_X86
+#endif
+
+//GCC and Clang only emit AVX2/FMA instructions in functions that opt in, MSVC accepts the intrinsics anywhere
+#if defined(DAE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DAE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define DAE_TARGET_AVX2
+#endif
+
+namespace dae
+{
+	namespace Simd
+	{
+		enum class Level
+		{
+			Scalar,
+			SSE, //4-wide
+			AVX2 //8-wide
+		};
+
+		//Widest level the CPU (and OS) supports, detected once
+		Level GetSupportedLevel();
+
+		//Level the kernels currently dispatch to, defaults to the supported level
+		Level GetLevel();
+
+		//Primitives the kernels test at once at the current level
+		uint32_t GetWidth();
+
+		//Forces a level (clamped to the supported one), e.g. to compare kernels in benchmarks
+		void SetLevel(Level level);
+
+		const char* ToString(Level level);
+
+		/**
+		 * \brief Intersects the triangles [first, first + count) of the store with one ray, 4 or 8 at a time
+		 * \param triangles precomputed triangle store, padded for full width loads
+		 * \param first first triangle (BVH order)
+		 * \param count number of triangles
+		 * \param ray ray to test, ray.max is shortened to the closest hit
+		 * \param cullMode cull mode to apply (already flipped for shadow rays)
+		 * \param anyHit return on the first hit instead of searching the closest one
+		 * \return index of the closest hit triangle or UINT32_MAX
+		 */
+		uint32_t IntersectTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, Ray& ray, TriangleCullMode cullMode, bool anyHit);
+
+		/**
+		 * \brief Intersects the spheres [first, first + count) of the store with one ray, 4 or 8 at a time
+		 * \param spheres sphere store, padded for full width loads
+		 * \param first first sphere
+		 * \param count number of spheres
+		 * \param ray ray to test, ray.max is shortened to the closest hit
+		 * \param anyHit return on the first hit instead of searching the closest one
+		 * \return index of the closest hit sphere or UINT32_MAX
+		 */
+		uint32_t IntersectSpheres(const SphereSoA& spheres, uint32_t first, uint32_t count, Ray& ray, bool anyHit);
+
+		/**
+		 * \brief Rotates (and scales) directions given as separate x, y and z arrays, 4 or 8 at a time
+		 * \param transform matrix whose 3x3 part is applied, like Matrix::TransformVector
+		 * \param pX, pY, pZ components of the directions
+		 * \param count number of directions
+		 * \param pOutX, pOutY, pOutZ receive the transformed components, may not overlap the input
+		 */
+		void TransformDirections(const Matrix& transform, const float* pX, const float* pY, const float* pZ, uint32_t count, float* pOutX, float* pOutY, float* pOutZ);
+	}
+}
@@ -0,0 +1,87 @@
+#include "Statistics.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace dae
+{
+	namespace Statistics
+	{
+#if DAE_ENABLE_STATISTICS
+		namespace
+		{
+			struct Registry
+			{
+				std::mutex mutex{};
+				std::vector<ThreadCounters*> threads{};
+				Counters retiredCounters{}; //Counted by threads that exited since the last collect
+			};
+
+			Registry& GetRegistry()
+			{
+				static Registry registry{};
+				return registry;
+			}
+		}
+
+		ThreadCounters::ThreadCounters()
+		{
+			Registry& registry{ GetRegistry() };
+			std::lock_guard lock{ registry.mutex };
+			registry.threads.push_back(this);
+		}
+
+		ThreadCounters::~ThreadCounters()
+		{
+			Registry& registry{ GetRegistry() };
+			std::lock_guard lock{ registry.mutex };
+			registry.retiredCounters += counters;
+			registry.threads.erase(std::remove(registry.threads.begin(), registry.threads.end(), this), registry.threads.end());
+		}
+
+		Counters CollectAndReset()
+		{
+			Registry& registry{ GetRegistry() };
+			std::lock_guard lock{ registry.mutex };
+
+			Counters total{ registry.retiredCounters };
+			registry.retiredCounters = {};
+			for (ThreadCounters* pThreadCounters : registry.threads)
+			{
+				total += pThreadCounters->counters;
+				pThreadCounters->counters = {};
+			}
+			return total;
+		}
+#else
+		Counters CollectAndReset()
+		{
+			return {};
+		}
+#endif
+
+		void Print(std::ostream& output, const Counters& counters)
+		{
+			output << "primary rays: " << counters.primaryRays << " (" << counters.primaryHits << " hits)"
+				<< ", shadow rays: " << counters.shadowRays << " (" << counters.shadowHits << " occluded)"
+				<< ", tests sphere/plane/triangle: " << counters.sphereTests << "/" << counters.planeTests << "/" << counters.triangleTests
+				<< ", BVH nodes: " << counters.bvhNodesVisited
+				<< ", occluder cache: " << counters.occluderCacheHits << "/" << counters.occluderCacheTests << " hits";
+		}
+
+		void WriteJson(std::ostream& output, const Counters& counters)
+		{
+			output << "{ \"primaryRays\": " << counters.primaryRays
+				<< ", \"primaryHits\": " << counters.primaryHits
+				<< ", \"shadowRays\": " << counters.shadowRays
+				<< ", \"shadowHits\": " << counters.shadowHits
+				<< ", \"sphereTests\": " << counters.sphereTests
+				<< ", \"planeTests\": " << counters.planeTests
+				<< ", \"triangleTests\": " << counters.triangleTests
+				<< ", \"bvhNodesVisited\": " << counters.bvhNodesVisited
+				<< ", \"occluderCacheTests\": " << counters.occluderCacheTests
+				<< ", \"occluderCacheHits\": " << counters.occluderCacheHits << " }";
+		}
+	}
+}
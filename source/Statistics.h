@@ -0,0 +1,99 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <ostream>
+
+//Counting is on in debug builds only, define DAE_ENABLE_STATISTICS as 1 (or 0) in the preprocessor
+//definitions to force it. When off, the DAE_STATISTICS_* macros expand to nothing and nothing is counted.
+#ifndef DAE_ENABLE_STATISTICS
+#if defined(_DEBUG)
+#define DAE_ENABLE_STATISTICS 1
+#else
+#define DAE_ENABLE_STATISTICS 0
+#endif
+#endif
+
+namespace dae
+{
+	namespace Statistics
+	{
+		struct Counters
+		{
+			uint64_t primaryRays{};
+			uint64_t primaryHits{};
+			uint64_t shadowRays{};
+			uint64_t shadowHits{}; //Occluded shadow rays
+			uint64_t sphereTests{};
+			uint64_t planeTests{};
+			uint64_t triangleTests{};
+			uint64_t bvhNodesVisited{};
+			uint64_t occluderCacheTests{}; //Shadow rays tested against the last occluder toward their light
+			uint64_t occluderCacheHits{}; //... that it still blocked, skipping the traversal
+
+			Counters& operator+=(const Counters& counters)
+			{
+				primaryRays += counters.primaryRays;
+				primaryHits += counters.primaryHits;
+				shadowRays += counters.shadowRays;
+				shadowHits += counters.shadowHits;
+				sphereTests += counters.sphereTests;
+				planeTests += counters.planeTests;
+				triangleTests += counters.triangleTests;
+				bvhNodesVisited += counters.bvhNodesVisited;
+				occluderCacheTests += counters.occluderCacheTests;
+				occluderCacheHits += counters.occluderCacheHits;
+				return *this;
+			}
+		};
+
+		constexpr bool IsEnabled()
+		{
+			return DAE_ENABLE_STATISTICS != 0;
+		}
+
+#if DAE_ENABLE_STATISTICS
+		//Counters of one thread, registered on construction so CollectAndReset can find every thread's counters
+		struct ThreadCounters
+		{
+			ThreadCounters();
+			~ThreadCounters();
+
+			ThreadCounters(const ThreadCounters&) = delete;
+			ThreadCounters(ThreadCounters&&) noexcept = delete;
+			ThreadCounters& operator=(const ThreadCounters&) = delete;
+			ThreadCounters& operator=(ThreadCounters&&) noexcept = delete;
+
+			Counters counters{};
+		};
+
+		inline thread_local ThreadCounters g_ThreadCounters{};
+
+		//Counters of the calling thread, only that thread writes them
+		inline Counters& GetThreadCounters()
+		{
+			return g_ThreadCounters.counters;
+		}
+#endif
+
+		/**
+		 * \brief Sums the counters of every thread and resets them
+		 * Only call this while no thread is counting, e.g. between two ParallelFor dispatches
+		 */
+		Counters CollectAndReset();
+
+		//One line summary for the console
+		void Print(std::ostream& output, const Counters& counters);
+
+		//Counters as a JSON object
+		void WriteJson(std::ostream& output, const Counters& counters);
+	}
+}
+
+#if DAE_ENABLE_STATISTICS
+#define DAE_STATISTICS_ADD(counter, amount) (dae::Statistics::GetThreadCounters().counter += (amount))
+#define DAE_STATISTICS_INCREMENT(counter) (++dae::Statistics::GetThreadCounters().counter)
+#else
+#define DAE_STATISTICS_ADD(counter, amount) ((void)0)
+#define DAE_STATISTICS_INCREMENT(counter) ((void)0)
+#endif
@@ -0,0 +1,201 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint64_t PackRange(uint32_t begin, uint32_t end)
+		{
+			return (static_cast<uint64_t>(end) << 32) | begin;
+		}
+
+		constexpr uint32_t GetBegin(uint64_t range)
+		{
+			return static_cast<uint32_t>(range);
+		}
+
+		constexpr uint32_t GetEnd(uint64_t range)
+		{
+			return static_cast<uint32_t>(range >> 32);
+		}
+	}
+
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+		//Queue 0 belongs to the thread calling ParallelFor
+		m_pQueues = std::make_unique<WorkQueue[]>(threadCount);
+
+		m_Workers.reserve(threadCount - 1);
+		for (uint32_t i{ 1 }; i < threadCount; ++i)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::Dispatch(uint32_t count, uint32_t grainSize, RangeTask task, void* pContext)
+	{
+		if (count == 0)
+			return;
+
+		const uint32_t threadCount{ GetThreadCount() };
+		grainSize = std::max(grainSize, 1u);
+
+		//Nothing to share, skip waking the workers
+		if (threadCount == 1 || count <= grainSize)
+		{
+			for (uint32_t begin{}; begin < count; begin += std::min(grainSize, count - begin))
+			{
+				task(pContext, begin, begin + std::min(grainSize, count - begin));
+			}
+			return;
+		}
+
+		//Published to the workers by the release stores of the queues below
+		m_Task = task;
+		m_pContext = pContext;
+		m_GrainSize.store(grainSize, std::memory_order_relaxed);
+		m_RemainingItems.store(count, std::memory_order_relaxed);
+
+		//Contiguous initial ranges, neighbouring items (rows, tiles) stay on the same thread until stolen
+		for (uint32_t i{}; i < threadCount; ++i)
+		{
+			const uint32_t begin{ static_cast<uint32_t>(uint64_t(count) * i / threadCount) };
+			const uint32_t end{ static_cast<uint32_t>(uint64_t(count) * (i + 1) / threadCount) };
+			m_pQueues[i].range.store(PackRange(begin, end), std::memory_order_release);
+		}
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			++m_Generation;
+			m_IsDispatching = true;
+		}
+		m_WakeCondition.notify_all();
+
+		RunTasks(0);
+
+		//Other threads may still be executing their last chunk, or still be in Steal: a thief that stores its stolen
+		//range after the next dispatch filled the queues would overwrite a fresh range
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this]() { return m_RemainingItems.load(std::memory_order_acquire) == 0 && m_ActiveWorkers == 0; });
+		m_IsDispatching = false;
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t queueIndex)
+	{
+		uint64_t handledGeneration{};
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [&]() { return m_IsStopping || (m_IsDispatching && m_Generation != handledGeneration); });
+
+				if (m_IsStopping)
+					return;
+
+				handledGeneration = m_Generation;
+				++m_ActiveWorkers;
+			}
+
+			RunTasks(queueIndex);
+
+			std::lock_guard lock{ m_Mutex };
+			if (--m_ActiveWorkers == 0)
+				m_DoneCondition.notify_one();
+		}
+	}
+
+	void ThreadPool::RunTasks(uint32_t queueIndex)
+	{
+		uint32_t begin{};
+		uint32_t end{};
+		do
+		{
+			while (PopFront(queueIndex, begin, end))
+			{
+				Execute(begin, end);
+			}
+		} while (Steal(queueIndex));
+	}
+
+	void ThreadPool::Execute(uint32_t begin, uint32_t end)
+	{
+		m_Task(m_pContext, begin, end);
+
+		//The thread finishing the last items wakes the dispatching thread
+		const uint32_t itemCount{ end - begin };
+		if (m_RemainingItems.fetch_sub(itemCount, std::memory_order_acq_rel) == itemCount)
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_DoneCondition.notify_one();
+		}
+	}
+
+	bool ThreadPool::PopFront(uint32_t queueIndex, uint32_t& begin, uint32_t& end)
+	{
+		std::atomic<uint64_t>& queue{ m_pQueues[queueIndex].range };
+
+		uint64_t range{ queue.load(std::memory_order_acquire) };
+		while (true)
+		{
+			begin = GetBegin(range);
+			end = GetEnd(range);
+			if (begin >= end)
+				return false;
+
+			const uint32_t newBegin{ std::min(end, begin + m_GrainSize.load(std::memory_order_relaxed)) };
+			if (queue.compare_exchange_weak(range, PackRange(newBegin, end), std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				end = newBegin;
+				return true;
+			}
+		}
+	}
+
+	bool ThreadPool::Steal(uint32_t queueIndex)
+	{
+		const uint32_t threadCount{ GetThreadCount() };
+		for (uint32_t offset{ 1 }; offset < threadCount; ++offset)
+		{
+			std::atomic<uint64_t>& victim{ m_pQueues[(queueIndex + offset) % threadCount].range };
+
+			uint64_t range{ victim.load(std::memory_order_acquire) };
+			while (true)
+			{
+				const uint32_t begin{ GetBegin(range) };
+				const uint32_t end{ GetEnd(range) };
+				if (begin >= end)
+					break;
+
+				//Take the back half, the victim keeps working on the front it has warm in cache
+				const uint32_t split{ end - begin > m_GrainSize.load(std::memory_order_relaxed) ? begin + (end - begin) / 2 : begin };
+				if (victim.compare_exchange_weak(range, PackRange(begin, split), std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					//Our own queue is empty, nobody else modifies an empty range (Dispatch only refills the queues once
+					//every worker left RunTasks)
+					m_pQueues[queueIndex].range.store(PackRange(split, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace dae
+{
+	//Persistent pool of worker threads for data parallel loops. The threads are created once and
+	//sleep between dispatches, every worker owns a range of the loop and steals half of another
+	//worker's remaining range when it runs out, so uneven pixels (mesh vs background) balance out.
+	class ThreadPool final
+	{
+	public:
+		/**
+		 * \param threadCount total number of threads working on a dispatch, including the calling thread (0 = hardware concurrency)
+		 */
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		/**
+		 * \brief Runs function(begin, end) over [0, count) in chunks of at most grainSize items, blocks until all chunks are done
+		 * \param count number of items
+		 * \param grainSize items a thread takes at once, keeps per chunk overhead small for cheap items
+		 * \param function callable as function(uint32_t begin, uint32_t end), called concurrently from all threads
+		 */
+		template<typename Function>
+		void ParallelFor(uint32_t count, uint32_t grainSize, Function&& function)
+		{
+			using FunctionType = std::remove_reference_t<Function>;
+			Dispatch(count, grainSize, [](void* pFunction, uint32_t begin, uint32_t end)
+				{
+					(*static_cast<FunctionType*>(pFunction))(begin, end);
+				}, const_cast<void*>(static_cast<const void*>(&function)));
+		}
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	private:
+		using RangeTask = void(*)(void* pContext, uint32_t begin, uint32_t end);
+
+		//Remaining range of one thread packed as (end << 32 | begin) so the owner and thieves can update it with one CAS,
+		//each on its own cache line so the threads do not invalidate each other's ranges
+		struct alignas(64) WorkQueue
+		{
+			std::atomic<uint64_t> range{};
+		};
+
+		std::vector<std::thread> m_Workers{};
+		std::unique_ptr<WorkQueue[]> m_pQueues{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+		uint64_t m_Generation{};
+		bool m_IsDispatching{ false }; //Workers that wake up after the dispatch finished must not join the next one's queues
+		uint32_t m_ActiveWorkers{}; //Workers inside RunTasks, a dispatch only returns once they all left
+		bool m_IsStopping{ false };
+
+		RangeTask m_Task{};
+		void* m_pContext{};
+		std::atomic<uint32_t> m_GrainSize{ 1 }; //Atomic, late workers of the previous dispatch may still be looking for work
+		std::atomic<uint32_t> m_RemainingItems{};
+
+		void Dispatch(uint32_t count, uint32_t grainSize, RangeTask task, void* pContext);
+		void WorkerLoop(uint32_t queueIndex);
+		void RunTasks(uint32_t queueIndex);
+		void Execute(uint32_t begin, uint32_t end);
+
+		bool PopFront(uint32_t queueIndex, uint32_t& begin, uint32_t& end);
+		bool Steal(uint32_t queueIndex);
+	};
+}
@@ -1,8 +1,15 @@
 #pragma once
+#include <bit>
 #include <cassert>
-#include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "ObjLoader.h"
+#include "Simd.h"
+#include "Statistics.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
 
 namespace dae
 {
@@ -32,8 +39,8 @@ namespace dae
 			else
 			{
 
-				float SquareD{ std::sqrtf(D) };
-				float t{ (-B - (SquareD)) / 2 * A };
+				float SquareD{ std::sqrt(D) };
+				float t{ (-B - (SquareD)) / (2 * A) };
 
 				if (t >= tMin && t <= tMax)
 				{
@@ -57,6 +64,33 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Sphere(sphere, ray, temp, true);
 		}
+
+		/**
+		 * \brief Nearest root test against one sphere of the SoA store, same math as the batched kernels
+		 * \param spheres sphere store
+		 * \param index sphere to test
+		 * \param ray ray to test
+		 * \param t distance along the ray, only written on a hit
+		 * \return true when hit within [ray.min, ray.max]
+		 */
+		inline bool HitTest_Sphere(const SphereSoA& spheres, uint32_t index, const Ray& ray, float& t)
+		{
+			const Vector3 originToCenter{ ray.origin.x - spheres.originX[index], ray.origin.y - spheres.originY[index], ray.origin.z - spheres.originZ[index] };
+
+			//Half-b form of the quadratic
+			const float a{ Vector3::Dot(ray.direction, ray.direction) };
+			const float halfB{ Vector3::Dot(ray.direction, originToCenter) };
+			const float c{ Vector3::Dot(originToCenter, originToCenter) - spheres.radius[index] * spheres.radius[index] };
+
+			const float discriminant{ halfB * halfB - a * c };
+			if (discriminant < 0.f) return false;
+
+			const float hitT{ (-halfB - std::sqrt(discriminant)) / a };
+			if (hitT < ray.min || hitT > ray.max) return false;
+
+			t = hitT;
+			return true;
+		}
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
@@ -156,49 +190,237 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Triangle(triangle, ray, temp, true);
 		}
+
+		/**
+		 * \brief Moller-Trumbore test against one precomputed triangle, only touches v0 and the two edges
+		 * \param triangles precomputed triangle store
+		 * \param index triangle to test
+		 * \param ray ray to test
+		 * \param cullMode cull mode to apply (already flipped for shadow rays)
+		 * \param t distance along the ray, only written on a hit
+		 * \return true when hit within [ray.min, ray.max]
+		 */
+		inline bool HitTest_Triangle(const TriangleSoA& triangles, uint32_t index, const Ray& ray, TriangleCullMode cullMode, float& t)
+		{
+			const Vector3 edge1{ triangles.edge1X[index], triangles.edge1Y[index], triangles.edge1Z[index] };
+			const Vector3 edge2{ triangles.edge2X[index], triangles.edge2Y[index], triangles.edge2Z[index] };
+
+			//det == -Dot(normal, ray.direction) for the geometric normal Cross(edge1, edge2)
+			const Vector3 pVector{ Vector3::Cross(ray.direction, edge2) };
+			const float det{ Vector3::Dot(edge1, pVector) };
+			if (det == 0.f) return false;
+			if (cullMode == TriangleCullMode::BackFaceCulling && det < 0.f) return false;
+			if (cullMode == TriangleCullMode::FrontFaceCulling && det > 0.f) return false;
+
+			const float invDet{ 1.f / det };
+			const Vector3 tVector{ ray.origin.x - triangles.v0X[index], ray.origin.y - triangles.v0Y[index], ray.origin.z - triangles.v0Z[index] };
+
+			const float u{ Vector3::Dot(tVector, pVector) * invDet };
+			if (u < 0.f || u > 1.f) return false;
+
+			const Vector3 qVector{ Vector3::Cross(tVector, edge1) };
+			const float v{ Vector3::Dot(ray.direction, qVector) * invDet };
+			if (v < 0.f || u + v > 1.f) return false;
+
+			const float hitT{ Vector3::Dot(edge2, qVector) * invDet };
+			if (hitT < ray.min || hitT > ray.max) return false;
+
+			t = hitT;
+			return true;
+		}
 #pragma endregion
-#pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+#pragma region AABB HitTest
+		//Slab test, returns the entry distance or FLT_MAX on a miss so callers can order their traversal
+		inline float HitTest_AABB(const AABB& bounds, const Ray& ray, const Vector3& invDirection)
 		{
-			//todo W5
-			
-			HitRecord testHit{};
-			testHit.t = FLT_MAX;
-			int normalIndex{ 0 };
-			for (int i{}; i < mesh.indices.size(); i += 3)
+			const float tx1{ (bounds.min.x - ray.origin.x) * invDirection.x };
+			const float tx2{ (bounds.max.x - ray.origin.x) * invDirection.x };
+			float tMin{ std::min(tx1, tx2) };
+			float tMax{ std::max(tx1, tx2) };
+
+			const float ty1{ (bounds.min.y - ray.origin.y) * invDirection.y };
+			const float ty2{ (bounds.max.y - ray.origin.y) * invDirection.y };
+			tMin = std::max(tMin, std::min(ty1, ty2));
+			tMax = std::min(tMax, std::max(ty1, ty2));
+
+			const float tz1{ (bounds.min.z - ray.origin.z) * invDirection.z };
+			const float tz2{ (bounds.max.z - ray.origin.z) * invDirection.z };
+			tMin = std::max(tMin, std::min(tz1, tz2));
+			tMax = std::min(tMax, std::max(tz1, tz2));
+
+			if (tMax >= tMin && tMax >= ray.min && tMin <= ray.max)
+				return tMin;
+
+			return FLT_MAX;
+		}
+#pragma endregion
+#pragma region BVH Traversal
+		/**
+		 * \brief Slab test of all children of a wide node at once, child for child the same comparisons as HitTest_AABB
+		 * \param node node whose children to test
+		 * \param ray ray to test
+		 * \param invDirection 1 / ray.direction
+		 * \param distances receives the entry distance per child, only meaningful for the children that are hit
+		 * \return children hit (bit per slot), empty slots never are
+		 */
+		inline int HitTest_WideNode(const BVHWideNode& node, const Ray& ray, const Vector3& invDirection, float* distances)
+		{
+#if defined(DAE_SIMD_X86)
+			const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 invDirectionX{ _mm_set1_ps(invDirection.x) };
+			const __m128 invDirectionY{ _mm_set1_ps(invDirection.y) };
+			const __m128 invDirectionZ{ _mm_set1_ps(invDirection.z) };
+
+			const __m128 tx1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), invDirectionX) };
+			const __m128 tx2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), invDirectionX) };
+			__m128 tMin{ _mm_min_ps(tx2, tx1) };
+			__m128 tMax{ _mm_max_ps(tx2, tx1) };
+
+			const __m128 ty1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), invDirectionY) };
+			const __m128 ty2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), invDirectionY) };
+			tMin = _mm_max_ps(_mm_min_ps(ty2, ty1), tMin);
+			tMax = _mm_min_ps(_mm_max_ps(ty2, ty1), tMax);
+
+			const __m128 tz1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), invDirectionZ) };
+			const __m128 tz2{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), invDirectionZ) };
+			tMin = _mm_max_ps(_mm_min_ps(tz2, tz1), tMin);
+			tMax = _mm_min_ps(_mm_max_ps(tz2, tz1), tMax);
+
+			_mm_storeu_ps(distances, tMin);
+
+			const __m128 hit{ _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(tMax, tMin), _mm_cmpge_ps(tMax, _mm_set1_ps(ray.min))), _mm_cmple_ps(tMin, _mm_set1_ps(ray.max))) };
+			const __m128i empty{ _mm_cmpeq_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(node.children)), _mm_set1_epi32(-1)) };
+			return _mm_movemask_ps(_mm_andnot_ps(_mm_castsi128_ps(empty), hit));
+#else
+			int hitMask{ 0 };
+			for (uint32_t slot{}; slot < BVHWideNode::Width && node.children[slot] != BVHWideNode::EmptyChild; ++slot)
 			{
-				int v0 = mesh.indices[i];
-				int v1 = mesh.indices[i + 1];
-				int v2 = mesh.indices[i + 2];
+				const AABB bounds{ { node.minX[slot], node.minY[slot], node.minZ[slot] }, { node.maxX[slot], node.maxY[slot], node.maxZ[slot] } };
+				distances[slot] = HitTest_AABB(bounds, ray, invDirection);
+				if (distances[slot] != FLT_MAX)
+					hitMask |= 1 << slot;
+			}
+			return hitMask;
+#endif
+		}
 
-				Triangle currentTriangle = Triangle(
-					mesh.transformedPositions[v0],
-					mesh.transformedPositions[v1],
-					mesh.transformedPositions[v2],
-					mesh.transformedNormals[normalIndex]);
+		/**
+		 * \brief Walks the wide nodes of a BVH front to back and hands every leaf that the ray overlaps to the callback
+		 * \param bvh hierarchy to traverse
+		 * \param ray ray to test, the callback may shorten ray.max to cull farther nodes
+		 * \param leafCallback bool(uint32_t first, uint32_t count) over the BVH ordered primitive range, returns true to stop
+		 */
+		template<typename LeafCallback>
+		inline void TraverseBVH(const BVH& bvh, Ray& ray, LeafCallback&& leafCallback)
+		{
+			const std::vector<BVHWideNode>& nodes{ bvh.GetWideNodes() };
+			if (nodes.empty())
+				return;
 
-				currentTriangle.cullMode = mesh.cullMode;
-				currentTriangle.materialIndex = mesh.materialIndex;
+			const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
 
-				
-				if (GeometryUtils::HitTest_Triangle(currentTriangle, ray, testHit, ignoreHitRecord))
+			//Hit children wait here with their entry distance, so the ones behind a closer hit are skipped when popped
+			struct Entry
+			{
+				uint32_t child;
+				uint32_t primitiveCount; //0 for wide nodes
+				float distance;
+			};
+			Entry stack[BVH::MaxWideStackSize];
+			uint32_t stackSize{ 0 };
+			uint32_t nodeIndex{ 0 };
+			while (true)
+			{
+				DAE_STATISTICS_INCREMENT(bvhNodesVisited);
+
+				const BVHWideNode& node{ nodes[nodeIndex] };
+				alignas(16) float distances[BVHWideNode::Width];
+				int hitMask{ HitTest_WideNode(node, ray, invDirection, distances) };
+
+				//Sorted in while pushing, farthest first, so the nearest child is popped next
+				const uint32_t firstPushed{ stackSize };
+				for (; hitMask != 0; hitMask &= hitMask - 1)
 				{
-					if (ignoreHitRecord)
+					const int slot{ std::countr_zero(static_cast<uint32_t>(hitMask)) };
+					const Entry entry{ node.children[slot], node.primitiveCounts[slot], distances[slot] };
+
+					uint32_t i{ stackSize++ };
+					for (; i > firstPushed && stack[i - 1].distance < entry.distance; --i)
 					{
-						return true;
+						stack[i] = stack[i - 1];
 					}
-					else
+					stack[i] = entry;
+				}
+
+				//Leaves are handed over as they are popped, until the next wide node
+				while (true)
+				{
+					if (stackSize == 0)
+						return;
+
+					const Entry entry{ stack[--stackSize] };
+					if (entry.distance > ray.max)
+						continue;
+
+					if (entry.primitiveCount == 0)
 					{
-						if (testHit.t < hitRecord.t)
-						{
-							hitRecord = testHit;
-						}
+						nodeIndex = entry.child;
+						break;
 					}
-					
+
+					if (leafCallback(entry.child, entry.primitiveCount))
+						return;
 				}
-				++normalIndex;
 			}
-			return hitRecord.didHit;
+		}
+#pragma endregion
+#pragma region TriangeMesh HitTest
+		//HitTest_TriangleMesh with meshCullMode instead of the mesh's (e.g. of an instance), still flipped for shadows
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, TriangleCullMode meshCullMode, const Ray& ray, HitRecord& hitRecord,
+			bool ignoreHitRecord, uint32_t* pTriangleIndex)
+		{
+			//todo W5
+			// flip cullmode for shadows
+			TriangleCullMode cullMode{ meshCullMode };
+			if (ignoreHitRecord && cullMode != TriangleCullMode::NoCulling)
+				cullMode = TriangleCullMode(((int)cullMode + 1) % 2);
+
+			//Only closer hits matter, shrink the ray with every one of them so farther nodes get culled
+			Ray traversalRay{ ray };
+			traversalRay.max = std::min(ray.max, hitRecord.t);
+
+			uint32_t closestIndex{ UINT32_MAX };
+			TraverseBVH(mesh.bvh, traversalRay, [&](uint32_t first, uint32_t count)
+				{
+					const uint32_t hitIndex{ Simd::IntersectTriangles(mesh.triangles, first, count, traversalRay, cullMode, ignoreHitRecord) };
+					if (hitIndex == UINT32_MAX)
+						return false;
+
+					closestIndex = hitIndex;
+					return ignoreHitRecord;
+				});
+
+			if (closestIndex == UINT32_MAX)
+				return false;
+
+			if (!ignoreHitRecord)
+			{
+				hitRecord.t = traversalRay.max;
+				hitRecord.materialIndex = mesh.materialIndex;
+				hitRecord.normal = mesh.triangles.normals[closestIndex];
+				hitRecord.didHit = true;
+				hitRecord.origin = ray.origin + (ray.direction * hitRecord.t);
+			}
+			if (pTriangleIndex)
+				*pTriangleIndex = closestIndex;
+			return true;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false, uint32_t* pTriangleIndex = nullptr)
+		{
+			return HitTest_TriangleMesh(mesh, mesh.cullMode, ray, hitRecord, ignoreHitRecord, pTriangleIndex);
 		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
@@ -206,6 +428,45 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_TriangleMesh(mesh, ray, temp, true);
 		}
+
+		//Any hit test that also reports the blocking triangle (index in mesh.triangles), e.g. to remember it as occluder
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t& triangleIndex)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleMesh(mesh, ray, temp, true, &triangleIndex);
+		}
+
+		//HitTest_TriangleMesh of the shared mesh with the ray in object space and the cull mode of the instance, the hit
+		//record is filled in world space with the material of the instance
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord,
+			bool ignoreHitRecord = false, uint32_t* pTriangleIndex = nullptr)
+		{
+			HitRecord objectHit{};
+			objectHit.t = hitRecord.t;
+
+			uint32_t triangleIndex{};
+			if (!HitTest_TriangleMesh(mesh, instance.GetCullMode(mesh.cullMode), instance.ToObjectSpace(ray), objectHit, ignoreHitRecord, &triangleIndex))
+				return false;
+
+			if (!ignoreHitRecord)
+			{
+				hitRecord.t = objectHit.t;
+				hitRecord.materialIndex = instance.materialIndex;
+				hitRecord.normal = instance.TransformNormal(mesh.triangles.normals[triangleIndex]);
+				hitRecord.didHit = true;
+				hitRecord.origin = ray.origin + (ray.direction * hitRecord.t);
+			}
+			if (pTriangleIndex)
+				*pTriangleIndex = triangleIndex;
+			return true;
+		}
+
+		//Any hit test of an instance that also reports the blocking triangle (index in mesh.triangles)
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, uint32_t& triangleIndex)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleMeshInstance(instance, mesh, ray, temp, true, &triangleIndex);
+		}
 #pragma endregion
 	}
 
@@ -237,76 +498,10 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		//Parses vertices and faces (triangles, quads and polygons) and computes a normal per triangle, see ObjLoader::Load
+		inline bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
-
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
-			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
-
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
-
-				if (file.eof()) 
-					break;
-			}
-
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
-			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
-
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
-
-				if(isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normals.push_back(normal);
-			}
-
-			return true;
+			return ObjLoader::Load(filename, positions, normals, indices);
 		}
-#pragma warning(pop)
 	}
 }
\ No newline at end of file
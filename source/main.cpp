@@ -1,16 +1,23 @@
 //External includes
+#if defined(_WIN32)
 #include "vld.h"
+#endif
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
 
 //Standard includes
+#include <charconv>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "Statistics.h"
 
 using namespace dae;
 
@@ -20,43 +27,256 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
-int main(int argc, char* args[])
+enum class StatisticsOutput
+{
+	None,
+	Console,
+	Json
+};
+
+struct Options
+{
+	std::string sceneName{ "W4" };
+	uint32_t width{ 640 };
+	uint32_t height{ 480 };
+	uint32_t frameCount{ 1 };
+	std::string outputPath{ "RayTracing_Buffer.bmp" };
+	uint32_t tileSize{ 32 };
+	uint32_t threadCount{ 0 };
+	bool isHeadless{ false };
+	Renderer::LightingMode lightingMode{ Renderer::LightingMode::Combined };
+	float heatmapScale{ 64.f };
+	bool isPacketTracingEnabled{ true };
+	StatisticsOutput statisticsOutput{ StatisticsOutput::None };
+};
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [options]" << std::endl;
+	std::cout << "  --headless              render without a window and write the frames to disk" << std::endl;
+	std::cout << "  --scene <name>          W1, W2, W3, W4, Bunny or Instances (default W4)" << std::endl;
+	std::cout << "  --resolution <WxH>      image size (default 640x480)" << std::endl;
+	std::cout << "  --frames <n>            frames to render in headless mode (default 1)" << std::endl;
+	std::cout << "  --output <path.bmp>     headless output, frames after the first get a _<index> suffix" << std::endl;
+	std::cout << "  --tile <n>              tile size in pixels (default 32)" << std::endl;
+	std::cout << "  --threads <n>           render threads, 0 = all cores (default 0)" << std::endl;
+	std::cout << "  --statistics <mode>     print ray/test counts per frame (headless) or with the FPS: console or json" << std::endl;
+	std::cout << "  --lighting <mode>       observedarea, radiance, brdf, combined, nodes or tests (default combined)," << std::endl;
+	std::cout << "                          nodes and tests need a DAE_ENABLE_STATISTICS=1 build" << std::endl;
+	std::cout << "  --heatmap-scale <n>     per pixel count shown as red by the nodes/tests heatmaps (default 64)" << std::endl;
+	std::cout << "  --packets <on|off>      trace primary rays of 2x2 pixel quads together (default on)" << std::endl;
+	std::cout << "Keys: F2 shadows, F3 lighting mode, F5/F6 halve/double the heatmap scale, F7 packets, X screenshot" << std::endl;
+}
+
+bool ParseUInt(std::string_view text, uint32_t& value)
+{
+	const auto [pEnd, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	return error == std::errc{} && pEnd == text.data() + text.size();
+}
+
+bool ParseArguments(int argc, char* args[], Options& options)
+{
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string_view argument{ args[i] };
+		if (argument == "--headless")
+		{
+			options.isHeadless = true;
+			continue;
+		}
+
+		//Every other option takes a value
+		if (i + 1 >= argc)
+			return false;
+		const std::string_view value{ args[++i] };
+
+		if (argument == "--scene")
+		{
+			options.sceneName = value;
+		}
+		else if (argument == "--resolution")
+		{
+			const size_t separator{ value.find('x') };
+			if (separator == std::string_view::npos ||
+				!ParseUInt(value.substr(0, separator), options.width) ||
+				!ParseUInt(value.substr(separator + 1), options.height))
+				return false;
+		}
+		else if (argument == "--frames")
+		{
+			if (!ParseUInt(value, options.frameCount))
+				return false;
+		}
+		else if (argument == "--output")
+		{
+			options.outputPath = value;
+		}
+		else if (argument == "--tile")
+		{
+			if (!ParseUInt(value, options.tileSize))
+				return false;
+		}
+		else if (argument == "--threads")
+		{
+			if (!ParseUInt(value, options.threadCount))
+				return false;
+		}
+		else if (argument == "--statistics")
+		{
+			if (value == "console")
+				options.statisticsOutput = StatisticsOutput::Console;
+			else if (value == "json")
+				options.statisticsOutput = StatisticsOutput::Json;
+			else
+				return false;
+		}
+		else if (argument == "--lighting")
+		{
+			if (value == "observedarea")
+				options.lightingMode = Renderer::LightingMode::ObservedArea;
+			else if (value == "radiance")
+				options.lightingMode = Renderer::LightingMode::Radiance;
+			else if (value == "brdf")
+				options.lightingMode = Renderer::LightingMode::BRDF;
+			else if (value == "combined")
+				options.lightingMode = Renderer::LightingMode::Combined;
+			else if (value == "nodes")
+				options.lightingMode = Renderer::LightingMode::HeatmapNodes;
+			else if (value == "tests")
+				options.lightingMode = Renderer::LightingMode::HeatmapTests;
+			else
+				return false;
+		}
+		else if (argument == "--heatmap-scale")
+		{
+			uint32_t scale{};
+			if (!ParseUInt(value, scale) || scale == 0)
+				return false;
+			options.heatmapScale = float(scale);
+		}
+		else if (argument == "--packets")
+		{
+			if (value == "on")
+				options.isPacketTracingEnabled = true;
+			else if (value == "off")
+				options.isPacketTracingEnabled = false;
+			else
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return options.width > 0 && options.height > 0 && options.frameCount > 0;
+}
+
+void PrintStatistics(StatisticsOutput output, const Renderer& renderer)
+{
+	switch (output)
+	{
+	case StatisticsOutput::Console:
+		std::cout << "Statistics: ";
+		Statistics::Print(std::cout, renderer.GetStatistics());
+		std::cout << std::endl;
+		break;
+	case StatisticsOutput::Json:
+		Statistics::WriteJson(std::cout, renderer.GetStatistics());
+		std::cout << std::endl;
+		break;
+	default:
+		break;
+	}
+}
+
+//Builds the scene's BVHs on the render threads, which are idle until the first frame
+void InitializeScene(Scene* pScene, Renderer& renderer)
+{
+	pScene->SetThreadPool(&renderer.GetThreadPool());
+	pScene->Initialize();
+	pScene->BuildAccelerationStructure();
+	pScene->PrintAccelerationStructure(std::cout);
+}
+
+//"out.bmp" -> "out_0003.bmp"
+std::string GetFramePath(const std::string& path, uint32_t frameIndex)
+{
+	std::string index{ std::to_string(frameIndex) };
+	index.insert(0, index.size() < 4 ? 4 - index.size() : 0, '0');
+
+	const size_t extension{ path.find_last_of('.') };
+	if (extension == std::string::npos || path.find_first_of("/\\", extension) != std::string::npos)
+		return path + "_" + index;
+
+	return path.substr(0, extension) + "_" + index + path.substr(extension);
+}
+
+int RunHeadless(const Options& options, Scene* pScene)
 {
+	Timer timer{};
+	Renderer renderer{ options.width, options.height, options.threadCount };
+	renderer.SetTileSize(options.tileSize);
+	renderer.SetLightingMode(options.lightingMode);
+	renderer.SetHeatmapScale(options.heatmapScale);
+	renderer.SetPacketTracing(options.isPacketTracingEnabled);
+	InitializeScene(pScene, renderer);
+
+	std::cout << "Rendering " << options.frameCount << " frame(s) of " << options.sceneName
+		<< " at " << options.width << "x" << options.height
+		<< " on " << renderer.GetThreadCount() << " thread(s)" << std::endl;
+	renderer.PrintLightingMode(std::cout);
+
+	timer.Start();
+	for (uint32_t frame{}; frame < options.frameCount; ++frame)
+	{
+		pScene->Update(&timer);
+
+		const auto start{ std::chrono::steady_clock::now() };
+		renderer.Render(pScene);
+		const auto end{ std::chrono::steady_clock::now() };
+
+		const std::string path{ frame == 0 ? options.outputPath : GetFramePath(options.outputPath, frame) };
+		if (!renderer.SaveBufferToImage(path))
+		{
+			std::cout << "Could not write " << path << std::endl;
+			return 1;
+		}
+
+		std::cout << "Frame " << frame << ": " << std::chrono::duration<double, std::milli>(end - start).count()
+			<< " ms -> " << path << std::endl;
+		PrintStatistics(options.statisticsOutput, renderer);
 
-	//test
-	/*float dotresult{};
-	dotresult = Vector3::Dot(Vector3::UnitX, -Vector3::UnitX);*/
-	/*Vector3 crossResult{};
-	crossResult = Vector3::Cross(Vector3::UnitX, Vector3::UnitZ);*/
+		timer.Update();
+	}
+	timer.Stop();
 
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	return 0;
+}
 
+int RunWindowed(const Options& options, Scene* pScene)
+{
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
-
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - **Rafi Osmanu**",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		width, height, 0);
+		options.width, options.height, 0);
 
 	if (!pWindow)
 		return 1;
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
-
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3();
-	const auto pScene = new Scene_W4();
-	pScene->Initialize();
+	const auto pRenderer = new Renderer(pWindow, options.threadCount);
+	pRenderer->SetTileSize(options.tileSize);
+	pRenderer->SetLightingMode(options.lightingMode);
+	pRenderer->SetHeatmapScale(options.heatmapScale);
+	pRenderer->SetPacketTracing(options.isPacketTracingEnabled);
+	pRenderer->PrintLightingMode(std::cout);
+	InitializeScene(pScene, *pRenderer);
 
 	//Start loop
 	pTimer->Start();
@@ -82,7 +302,21 @@ int main(int argc, char* args[])
 				else if(e.key.keysym.scancode == SDL_SCANCODE_F2)
 					pRenderer->ToggleShadows();
 				else if (e.key.keysym.scancode == SDL_SCANCODE_F3)
+				{
 					pRenderer->CycleLightingMode();
+					pRenderer->PrintLightingMode(std::cout);
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F5 || e.key.keysym.scancode == SDL_SCANCODE_F6)
+				{
+					const float factor{ e.key.keysym.scancode == SDL_SCANCODE_F5 ? 0.5f : 2.f };
+					pRenderer->SetHeatmapScale(pRenderer->GetHeatmapScale() * factor);
+					pRenderer->PrintLightingMode(std::cout);
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+				{
+					pRenderer->TogglePacketTracing();
+					std::cout << "Packet tracing " << (pRenderer->IsPacketTracingEnabled() ? "on" : "off") << std::endl;
+				}
 				break;
 			}
 		}
@@ -100,12 +334,13 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			PrintStatistics(options.statisticsOutput, *pRenderer);
 		}
 
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (pRenderer->SaveBufferToImage())
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
@@ -115,10 +350,42 @@ int main(int argc, char* args[])
 	pTimer->Stop();
 
 	//Shutdown "framework"
-	delete pScene;
 	delete pRenderer;
 	delete pTimer;
 
 	ShutDown(pWindow);
 	return 0;
+}
+
+int main(int argc, char* args[])
+{
+	Options options{};
+	if (!ParseArguments(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.statisticsOutput != StatisticsOutput::None && !Statistics::IsEnabled())
+		std::cout << "Statistics are compiled out, build with DAE_ENABLE_STATISTICS=1 to count rays and tests" << std::endl;
+
+	//The heatmaps are drawn from the statistics, without them every pixel would be black
+	const bool isHeatmap{ options.lightingMode == Renderer::LightingMode::HeatmapNodes || options.lightingMode == Renderer::LightingMode::HeatmapTests };
+	if (isHeatmap && !Statistics::IsEnabled())
+	{
+		std::cout << "The nodes and tests lighting modes need statistics, build with DAE_ENABLE_STATISTICS=1" << std::endl;
+		return 1;
+	}
+
+	Scene* pScene{ CreateScene(options.sceneName) };
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << options.sceneName << std::endl;
+		PrintUsage();
+		return 1;
+	}
+	const int result{ options.isHeadless ? RunHeadless(options, pScene) : RunWindowed(options, pScene) };
+
+	delete pScene;
+	return result;
 }
\ No newline at end of file